@@ -0,0 +1,167 @@
+/*
+ * AllocationTrace.h
+ *
+ * Binary allocation traces of a real program, recorded by libMemAlloc.so and
+ * replayed against any Heap with the replay tool (src/mainReplay.cc).
+ *
+ * Recording is switched on with the environment variable MEMALLOC_TRACE=<file>,
+ * "%p" in the file name is replaced by the process id (use it if the program
+ * starts other processes, they inherit the variable).
+ * Every thread buffers its records and writes them as one chunk when the
+ * buffer is full or the thread exits, the buffer is taken by the next thread
+ * then. The file looks like this:
+ *
+ *   AllocTraceHeader
+ *   AllocTraceChunk, chunk.count * AllocRecord
+ *   AllocTraceChunk, chunk.count * AllocRecord
+ *   ...
+ *
+ * Objects are identified by ids instead of addresses, so a trace can be
+ * replayed by a heap that places the objects differently.
+ */
+
+#ifndef AllocationTrace_h
+#define AllocationTrace_h
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <pthread.h>
+
+#define ALLOC_TRACE_MAGIC 0x5254414d //"MATR"
+#define ALLOC_TRACE_VERSION 1
+
+#define RECORD_BUFFER_SIZE 4096 //records per thread buffer
+#define MAX_RECORD_THREADS 256
+#define RECORDER_TABLE_BITS 22 //live objects the recorder can track: 2^22
+
+enum alloc_op : uint8_t
+{
+    ALLOC_MALLOC,
+    ALLOC_CALLOC,
+    ALLOC_REALLOC,
+    ALLOC_FREE
+};
+
+struct AllocTraceHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct AllocTraceChunk
+{
+    uint32_t thread;        //index of the recording thread
+    uint32_t count;         //records following this chunk header
+    uint64_t startTick;     //the delta of the first record is relative to this tick
+};
+
+struct AllocRecord
+{
+    uint64_t size;          //requested size, nmemb * size for calloc
+    uint32_t id;            //object that was allocated or freed, 0 if the call failed
+    uint32_t oldId;         //realloc only: object that was resized, 0 for realloc(NULL, size)
+    uint32_t delta;         //ticks since the previous record of the same thread
+    alloc_op op;
+    uint8_t reserved[3];
+};
+
+/**
+ * Records the calls of the global allocator. It never calls malloc itself:
+ * the buffers and the address to id table are mmap'ed.
+ */
+class AllocationRecorder
+{
+public:
+    /**
+     * Starts recording if MEMALLOC_TRACE names a file.
+     */
+    AllocationRecorder();
+
+    /**
+     * Writes the outstanding buffers of all threads and closes the trace.
+     */
+    ~AllocationRecorder();
+
+    /**
+     * Records one call of malloc, calloc or free, realloc is recorded in two steps.
+     *
+     * @param op the allocator function
+     * @param result pointer returned by the call, NULL for free
+     * @param old pointer passed to free
+     * @param size requested size
+     */
+    void record(alloc_op op, const void* result, const void* old, size_t size)
+    {
+        if (enabled.load(std::memory_order_relaxed)) {
+            append(op, result, old, size, 0);
+        }
+    }
+
+    /**
+     * Takes the id of a block before realloc is called. A moved block goes back
+     * to the heap in realloc and another thread may get its address at once,
+     * its id must not be in the table any more then.
+     *
+     * @return id of the block, passed to recordRealloc()
+     */
+    uint32_t detachRealloc(const void* old)
+    {
+        if (old != NULL && enabled.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(tableMutex);
+            return removeId(old);
+        }
+        return 0;
+    }
+
+    /**
+     * Records a realloc after detachRealloc(), a block that failed to grow gets its id back.
+     */
+    void recordRealloc(const void* result, const void* old, uint32_t oldId, size_t size)
+    {
+        if (enabled.load(std::memory_order_relaxed)) {
+            append(ALLOC_REALLOC, result, old, size, oldId);
+        }
+    }
+
+private:
+    struct Buffer
+    {
+        std::atomic<bool> claimed;
+        AllocationRecorder* recorder;
+        uint32_t count;
+        uint64_t startTick;
+        uint64_t lastTick;
+        AllocRecord* records;
+    };
+
+    void append(alloc_op op, const void* result, const void* old, size_t size, uint32_t oldId);
+    Buffer* ownBuffer();
+    static void releaseBuffer(void* buffer);
+    void flush(Buffer* buffer);
+
+    size_t findSlot(const void* address);
+    uint32_t insertId(const void* address);
+    void restoreId(const void* address, uint32_t id);
+    uint32_t removeId(const void* address);
+
+    std::atomic<bool> enabled;
+    int fd;
+    std::mutex writeMutex;
+    //its destructor gives the buffer of an exiting thread back
+    pthread_key_t bufferKey;
+    bool bufferKeyCreated;
+
+    //open addressing table from the address of a live object to its id
+    std::mutex tableMutex;
+    const void** tableKeys;
+    uint32_t* tableIds;
+    size_t tableUsed;
+    uint32_t nextId;
+
+    std::atomic<unsigned> lostRecords;
+    Buffer buffers[MAX_RECORD_THREADS];
+};
+
+#endif
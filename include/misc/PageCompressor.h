@@ -0,0 +1,38 @@
+/*
+ * PageCompressor.h
+ *
+ * Fast LZ77 codec for single pages, in the block format of LZ4: a sequence is
+ * a token (4 bits literal length, 4 bits match length - 4), the literals, a
+ * 2 byte offset and the extension bytes of the lengths. The last sequence has
+ * no match. Matches are found with a hash table of the last position of every
+ * 4 byte prefix, there is no search for a longer match.
+ *
+ * The compressor doesn't allocate, the hash table is a member, so it can be
+ * used in the fault handler. One compressor is used by one thread at a time.
+ */
+
+#ifndef PageCompressor_h
+#define PageCompressor_h
+
+#include <sys/types.h>
+
+#define COMPRESSOR_HASH_BITS 12
+
+class PageCompressor
+{
+public:
+    /**
+     * @return length of the compressed data, 0 if it doesn't fit in capacity bytes
+     */
+    size_t compress(const char* source, size_t size, char* destination, size_t capacity);
+
+    /**
+     * @return false if the data is corrupt or doesn't decompress to exactly size bytes
+     */
+    bool decompress(const char* source, size_t length, char* destination, size_t size);
+
+private:
+    int table[1 << COMPRESSOR_HASH_BITS];
+};
+
+#endif
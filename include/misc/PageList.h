@@ -0,0 +1,90 @@
+#ifndef PAGELIST_H
+#define PAGELIST_H
+
+#include <cstddef>
+
+#define NO_PAGE 0xFFFFFFFFu
+
+/*
+ * Intrusive doubly linked lists of pages. The links are not allocated per
+ * element, every page of the area has a node in PageLinks, indexed by its page
+ * number. So finding, moving and removing a page is O(1), there is no
+ * capacity besides the area, and no memory is allocated after create().
+ * A page is in at most one list of a PageLinks at a time.
+ */
+class PageLinks
+{
+public:
+    /**
+     * Maps the nodes of the pages of the area, they are only backed once they are used.
+     *
+     * @return false if the mmap failed
+     */
+    bool create(void* start, size_t pageSize, size_t pages);
+
+    void destroy();
+
+    unsigned pageIndex(void* page);
+
+    void* pageAddress(unsigned index);
+
+    /**
+     * One bit per page the owner of the lists may use, e.g. as reference bit.
+     */
+    bool isMarked(void* page);
+
+    void setMarked(void* page, bool marked);
+
+private:
+    friend class PageList;
+
+    char* start = NULL;
+    size_t pageSize = 0;
+    size_t pages = 0;
+    unsigned* previous = NULL;
+    unsigned* next = NULL;
+    //list the page is in (0 = none), the highest bit is the mark
+    unsigned char* owner = NULL;
+};
+
+class PageList
+{
+public:
+    /**
+     * @param id different for every list of the links, 1 to 127
+     */
+    PageList(PageLinks& links, unsigned char id);
+
+    //adds the page as the youngest element
+    void enqueue(void* page);
+
+    //removes and returns the oldest element, NULL if the list is empty
+    void* dequeue();
+
+    //oldest element, it stays in the list
+    void* peek();
+
+    bool contains(void* page);
+
+    //removes the page wherever it is, the order of the others stays
+    bool remove(void* page);
+
+    //makes a page of the list the youngest element
+    void moveToRear(void* page);
+
+    //drops all elements
+    void clear();
+
+    size_t size();
+
+    bool checkEmpty();
+
+private:
+    PageLinks& links;
+    unsigned char id;
+    unsigned front = NO_PAGE;
+    unsigned rear = NO_PAGE;
+    size_t count = 0;
+};
+
+#endif
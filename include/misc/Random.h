@@ -0,0 +1,47 @@
+/*
+ * Random.h
+ *
+ * Small xorshift generator for the benchmarks, rand() takes a global lock
+ * and would serialize the threads.
+ */
+
+#ifndef Random_h
+#define Random_h
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <algorithm>
+
+class Random
+{
+public:
+	Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+	uint64_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	/**
+	 * Log-uniform size, small objects are more likely than large ones.
+	 */
+	size_t size(size_t minSize, size_t maxSize)
+	{
+		size_t limit = minSize;
+		size_t steps = 0;
+		while (limit < maxSize) {
+			limit *= 2;
+			steps++;
+		}
+		size_t upper = std::min(maxSize, minSize << (next() % (steps + 1)));
+		return minSize + next() % (upper - minSize + 1);
+	}
+
+private:
+	uint64_t state;
+};
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <sys/types.h>
 
+//attempts of a transfer of readFully/writeFully that fails or makes no progress
+#define SWAP_IO_ATTEMPTS 3
+
 /**
 	This class provides an interface, for storing data in a random access way.
 	Additionally reservation of space, needed in the future, is supported.
@@ -43,6 +46,95 @@ class RandomAccessFile
             @return value is the amount of bytes which could be reserved
         */
         virtual ssize_t swapFilereserve(off_t offset, size_t bytes) = 0;
+
+        /**
+            This function gives the space of a specified amount of bytes back, they read as zeros.
+            Beginning at the offset in the file.
+
+            @param offset is the position in file, where the released space starts
+            @param bytes is the amount of bytes, which are not needed any more
+            @return value is the amount of bytes which could be released
+        */
+        virtual ssize_t swapFilerelease(off_t offset, size_t bytes) = 0;
+
+        /**
+            These functions transfer like swapFileRead/swapFileWrite. A short transfer is
+            continued and a failed one repeated, up to SWAP_IO_ATTEMPTS times.
+
+            @return value is true if all bytes were copied
+        */
+        bool readFully(void* addr, off_t offset, size_t bytes)
+        {
+            return transferFully(false, (char*) addr, offset, bytes);
+        }
+
+        bool writeFully(void* addr, off_t offset, size_t bytes)
+        {
+            return transferFully(true, (char*) addr, offset, bytes);
+        }
+
+        /**
+            These functions queue a transfer like swapFileRead/swapFileWrite. The memory
+            must not be used before complete() returned. Files without asynchronous
+            I/O do the transfer right away.
+        */
+        virtual void queueRead(void* addr, off_t offset, size_t bytes)
+        {
+            addCompleted(swapFileRead(addr, offset, bytes));
+        }
+
+        virtual void queueWrite(void* addr, off_t offset, size_t bytes)
+        {
+            addCompleted(swapFileWrite(addr, offset, bytes));
+        }
+
+        /**
+            This function starts the queued transfers without waiting for them.
+        */
+        virtual void submit() {}
+
+        /**
+            This function waits until all queued transfers are done.
+
+            @return value is the amount of bytes, which was copied by them, -1 if one of them failed
+        */
+        virtual ssize_t complete()
+        {
+            ssize_t bytes = completed;
+            completed = 0;
+            return bytes;
+        }
+
+    protected:
+        ssize_t completed = 0;
+
+        void addCompleted(ssize_t bytes)
+        {
+            if (bytes < 0 || completed < 0)
+                completed = -1;
+            else
+                completed += bytes;
+        }
+
+    private:
+        bool transferFully(bool write, char* addr, off_t offset, size_t bytes)
+        {
+            size_t done = 0;
+            unsigned failures = 0;
+            while (done < bytes)
+            {
+                ssize_t result = write ? swapFileWrite(addr + done, offset + done, bytes - done)
+                                       : swapFileRead(addr + done, offset + done, bytes - done);
+                if (result <= 0)
+                {
+                    if (++failures == SWAP_IO_ATTEMPTS)
+                        return false;
+                    continue;
+                }
+                done += result;
+            }
+            return true;
+        }
 };
 
 #endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <iostream>
+#include <cstdio>
 #include "misc/RandomAccessFile.h"
 
 
@@ -23,21 +24,24 @@ public:
 
     SwapFile()
     {
-        fd = open("SwapFile", O_RDWR | O_CREAT | O_TRUNC,  S_IRUSR | S_IWUSR);
+        //one file per process, it is removed right away and lives as long as the descriptor
+        char name[32];
+        snprintf(name, sizeof(name), "SwapFile.%d", (int) getpid());
+        fd = open(name, O_RDWR | O_CREAT | O_TRUNC,  S_IRUSR | S_IWUSR);
         if (fd == -1)
         {
             cerr << "Error Openining the swap file";
             exit(1);
         }
+        if (unlink(name) == -1)
+        {
+            cerr << "Error unlink didn't delete the swapfile" << endl;
+        }
     }
 
     ~SwapFile()
     {
         close(fd);
-        if (unlink("SwapFile") == -1)
-        {
-            cerr << "Error unlink didn't delete the swapfile" << endl;
-        }
     }
 
     /**
@@ -51,9 +55,8 @@ public:
         */
     virtual ssize_t swapFileRead(void *addr, off_t offset, size_t bytes)
     {
-        lseek(fd, offset, SEEK_SET);
-        read(fd, addr, bytes);
-        return bytes;
+        //pread doesn't move a shared file position, the write-back workers use the file as well
+        return pread(fd, addr, bytes, offset);
     }
 
     /**
@@ -67,9 +70,7 @@ public:
         */
     virtual ssize_t swapFileWrite(void *addr, off_t offset, size_t bytes)
     {
-        lseek(fd, offset, SEEK_SET);
-        write(fd, addr, bytes);
-        return 0;
+        return pwrite(fd, addr, bytes, offset);
     }
 
     /**
@@ -82,7 +83,23 @@ public:
         */
     virtual ssize_t swapFilereserve(off_t offset, size_t bytes)
     {
-        return 0;
+        //the blocks are allocated now and not by a write in a fault, where a full disk can't be handled.
+        //posix_fallocate is no fallback: without support it writes zeros, while the write-back is writing
+        if (fallocate(fd, 0, offset, bytes) == -1)
+        {
+            return 0;
+        }
+        return bytes;
+    }
+
+    virtual ssize_t swapFilerelease(off_t offset, size_t bytes)
+    {
+        //the file keeps its size, the blocks of the range are freed
+        if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, bytes) == -1)
+        {
+            return 0;
+        }
+        return bytes;
     }
 };
 
@@ -0,0 +1,127 @@
+/*
+ * TraceRing.h
+ *
+ * Allocation-free diagnostic tracing for the allocator.
+ * Every thread owns a fixed-size single-producer/single-consumer ring of
+ * trace events, it claims one on its first event and gives it back when it
+ * exits, so only MAX_TRACE_THREADS threads have to run at the same time.
+ * The hot path only writes an event into its own ring, it never calls into
+ * stdio or iostreams (those can allocate and lock, which would recurse into
+ * malloc). The rings are drained on demand with traceDrain() or
+ * periodically by a TraceDrainer thread.
+ */
+
+#ifndef TraceRing_h
+#define TraceRing_h
+
+#include <sys/types.h>
+#include <atomic>
+#include <unistd.h>
+#include "thread/Thread.h"
+
+#define TRACE_RING_SIZE 256 //events per thread, must be a power of two
+#define MAX_TRACE_THREADS 64
+
+enum trace_event : unsigned
+{
+    //informational events
+    TRACE_NEW,
+    TRACE_REALLOC,
+    TRACE_REALLOC_NULL,
+    //errors, everything from TRACE_FIRST_ERROR on is printed by default
+    TRACE_FIRST_ERROR,
+    TRACE_ZERO_ALLOC = TRACE_FIRST_ERROR,
+    TRACE_ZERO_CALLOC,
+    TRACE_OUT_OF_MEMORY,
+    TRACE_FREE_OUT_OF_RANGE,
+    TRACE_FREE_NOT_A_BLOCK,
+    TRACE_FREE_NOT_FIRST_BLOCK,
+    TRACE_REALLOC_NOT_A_BLOCK,
+    TRACE_HEAP_CORRUPTED,
+    TRACE_DOUBLE_FREE,
+    TRACE_CANARY_CORRUPTED,
+    TRACE_UNMAPPED_ACCESS,
+    TRACE_NESTED_FAULT,
+    TRACE_SWAP_IO_FAILED,
+    TRACE_NUMBER_OF_EVENTS
+};
+
+struct TraceEvent
+{
+    unsigned long long tick;
+    const void* address;
+    size_t size;
+    trace_event code;
+};
+
+class TraceRing
+{
+public:
+    /**
+     * Appends an event, only called by the owning thread and its signal handlers.
+     * The slot is reserved with a CAS on head before it is written, so an event
+     * pushed by a signal handler that interrupted a push gets a slot of its own.
+     * If the ring is full the event is dropped and counted.
+     */
+    void push(trace_event code, const void* address, size_t size, unsigned long long tick);
+
+    /**
+     * Removes the oldest event, only called by the (single) drainer.
+     * @return false if the ring is empty or the oldest event is still being written
+     */
+    bool pop(TraceEvent* event);
+
+    std::atomic<unsigned> head{0};
+    std::atomic<unsigned> tail{0};
+    std::atomic<unsigned> dropped{0};
+    std::atomic<bool> claimed{false};
+
+private:
+    TraceEvent events[TRACE_RING_SIZE];
+    //head + 1 of the event in the slot once it is written, head only reserves the slot
+    std::atomic<unsigned> written[TRACE_RING_SIZE] = {};
+};
+
+/**
+ * Records an event in the ring of the calling thread.
+ * Safe to call from malloc/free and from signal handlers, also from one that
+ * interrupted a traceEvent of the same thread.
+ * Informational events are only recorded after traceSetVerbose(true).
+ */
+void traceEvent(trace_event code, const void* address = NULL, size_t size = 0);
+
+void traceSetVerbose(bool verbose);
+
+/**
+ * Writes all pending events of all threads to the file descriptor.
+ * Formats the lines by hand on a stack buffer and only calls write(2), so it
+ * can be called from a signal handler. Concurrent drains spin on a flag, a
+ * drain of a thread that is draining already (a fault in it) returns at once.
+ *
+ * @param fd file descriptor to write to
+ * @param verbose also print informational events, not only errors
+ * @return number of events that were drained
+ */
+size_t traceDrain(int fd, bool verbose = false);
+
+/**
+ * Background thread that drains the trace rings periodically.
+ */
+class TraceDrainer : public Thread
+{
+public:
+    TraceDrainer(int fd, unsigned intervalMicros, bool verbose = false)
+        : fd(fd), intervalMicros(intervalMicros), verbose(verbose)
+    {
+        traceSetVerbose(verbose);
+    }
+
+    void run();
+
+private:
+    int fd;
+    unsigned intervalMicros;
+    bool verbose;
+};
+
+#endif
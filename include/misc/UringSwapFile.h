@@ -0,0 +1,94 @@
+/*
+ * UringSwapFile.h
+ *
+ * RandomAccessFile on the descriptor of a SwapFile that does the queued
+ * transfers with io_uring. The ring is set up with the raw system calls, so
+ * there is no library dependency. queueRead/queueWrite only fill submission
+ * entries, submit() hands all of them to the kernel with one call and
+ * complete() polls the completion ring for a while before it sleeps in the
+ * kernel. Memory that is registered with registerBuffer() is transferred with
+ * the fixed buffer operations, the kernel doesn't pin it for every request.
+ *
+ * A ring has a single producer: each thread that queues transfers needs its
+ * own UringSwapFile or a lock around the queue ... complete() sequence.
+ * Without io_uring (old kernel, seccomp, io_uring_disabled) the transfers are
+ * done with pread/pwrite when they are queued.
+ */
+
+#ifndef UringSwapFile_h
+#define UringSwapFile_h
+
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "misc/RandomAccessFile.h"
+
+#define URING_MAX_BUFFERS 4
+//completion ring checks before complete() sleeps in io_uring_enter
+#define URING_POLL_SPINS 2000
+
+class UringSwapFile : public RandomAccessFile
+{
+public:
+    ~UringSwapFile();
+
+    /**
+     * @param fd descriptor of the file, it stays owned by the caller
+     * @param entries requests in flight at the same time, rounded up to a power of two by the kernel
+     * @return false if io_uring is not available, pread/pwrite are used then
+     */
+    bool open(int fd, unsigned entries);
+
+    void close();
+
+    bool usesUring();
+
+    /**
+     * Registers memory the transfers use often, e.g. the buffer of the userfault engine.
+     *
+     * @return false if the kernel refused it, transfers to it still work
+     */
+    bool registerBuffer(void* addr, size_t bytes);
+
+    ssize_t swapFileRead(void* addr, off_t offset, size_t bytes);
+    ssize_t swapFileWrite(void* addr, off_t offset, size_t bytes);
+    ssize_t swapFilereserve(off_t offset, size_t bytes);
+    ssize_t swapFilerelease(off_t offset, size_t bytes);
+
+    void queueRead(void* addr, off_t offset, size_t bytes);
+    void queueWrite(void* addr, off_t offset, size_t bytes);
+    void submit();
+    ssize_t complete();
+
+private:
+    int fd = -1;
+    int ring = -1;
+    unsigned entries = 0;
+    //requests in the submission ring and requests the kernel didn't complete yet
+    unsigned queued = 0;
+    unsigned inFlight = 0;
+
+    void* ringMemory = NULL;
+    size_t ringSize = 0;
+    void* completionMemory = NULL;
+    size_t completionSize = 0;
+    struct io_uring_sqe* submissions = NULL;
+    size_t submissionsSize = 0;
+
+    unsigned* submissionTail = NULL;
+    unsigned* submissionMask = NULL;
+    unsigned* submissionArray = NULL;
+    unsigned* completionHead = NULL;
+    unsigned* completionTail = NULL;
+    unsigned* completionMask = NULL;
+    struct io_uring_cqe* completions = NULL;
+
+    struct iovec buffers[URING_MAX_BUFFERS];
+    unsigned bufferCount = 0;
+
+    void queue(bool write, void* addr, off_t offset, size_t bytes);
+    int fixedBuffer(void* addr, size_t bytes);
+    unsigned reap();
+};
+
+#endif
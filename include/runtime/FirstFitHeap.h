@@ -2,13 +2,34 @@
 #define FirstFitHeap_h
 
 #include <iostream>
+#include <cstring>
 #include "system/VirtualMem.h"
+#include "runtime/Heap.h"
+#include "runtime/HeapProfile.h"
+#include "runtime/PageMap.h"
+#include "runtime/HeapMaintenance.h"
+#include "misc/TraceRing.h"
 #include <vector>
 
 using namespace std;
 
 #define minByte sizeof(freeBlock)
 #define sizeUnsi sizeof(unsigned)
+//size of the meta data in front of every used block (block size and, if enabled, a canary)
+#define sizeHeader (HeapProfile::canaries ? 2 * sizeUnsi : sizeUnsi)
+
+//allocations of at least this size get their own mapping outside of the virtual memory
+#define LARGE_BLOCK_THRESHOLD (128 * 1024)
+#define LARGE_BLOCK_MAGIC 0x1a26eb10c4a11ec0
+
+//free blocks of at least this size give their whole pages back to the virtual memory
+#define DISCARD_THRESHOLD (64 * 1024)
+
+//allocations up to this size are header-free objects in size class spans
+#define SMALL_OBJECT_MAX 32
+#define SMALL_SIZE_CLASS_STEP 8
+#define SMALL_SIZE_CLASSES (SMALL_OBJECT_MAX / SMALL_SIZE_CLASS_STEP)
+#define SPAN_PAGES 16
 
 class freeBlock {
 public:
@@ -16,9 +37,16 @@ public:
     freeBlock* nextAddress = NULL;
 };
 
+//meta data at the start of the mapping of a large block
+class largeBlock {
+public:
+    size_t mappedSize;
+    size_t magic;
+};
+
 void signalHandler(int sigNUmber, siginfo_t *info, void *ucontext);
 
-class FirstFitHeap {
+class FirstFitHeap : public Heap {
 public:
 
     FirstFitHeap();
@@ -44,17 +72,68 @@ public:
     void operator delete[](void* ptr);
 
 	int getSize();
+
+    void fillList(list<int>* list);
+
+    size_t getFreeBytes();
+
+    size_t getLargestFreeBlock();
+
+    /**
+     * Starts the background maintenance worker, from now on free() defers
+     * coalescing to it.
+     *
+     * @param intervalMicros time between two maintenance passes
+     */
+    void startMaintenance(unsigned intervalMicros);
+
+    /**
+     * Stops the worker and does the outstanding work inline.
+     */
+    void stopMaintenance();
+
+    /**
+     * One maintenance pass: merges the deferred free blocks into the free list,
+     * gives the pages of the freed parts of large free blocks back to the virtual
+     * memory and releases empty spans.
+     */
+    void maintain();
    
 private:
     
-    void fillList(list<int>* list);
     void merge(freeBlock* block1, freeBlock* block2);
-    void addBlockInList(freeBlock* block);
+    freeBlock* addBlockInList(freeBlock* block);
     bool correctAddress(void* address);
+    bool checkBlock(unsigned* blockStart, trace_event error);
+
+    void* firstFitMalloc(size_t size);
+    void mergeDeferredFrees(bool discardPages = false);
+    void discardFreePages(freeBlock* block, char* freed, size_t freedBytes);
+
+    void* smallMalloc(size_t size);
+    void smallFree(Span* span, void* ptr);
+    Span* newSpan(unsigned sizeClass);
+    void releaseSpan(Span* span);
+
+    void* largeMalloc(size_t size);
+    void* largeRealloc(void* ptr, size_t size);
+    void largeFree(void* ptr);
+    bool isLargeBlock(void* ptr);
     
     struct sigaction SigAction;
     freeBlock* head;
 
+    PageMap pageMap;
+    //per size class, spans that still have free objects
+    Span* smallSpans[SMALL_SIZE_CLASSES] = {};
+
+    //protects the free list and the spans, the maintenance worker takes it as well
+    std::recursive_mutex heapMutex;
+    //first fit blocks freed while the worker runs, linked through nextAddress
+    std::atomic<freeBlock*> deferredFrees;
+    std::atomic<bool> deferFrees;
+    HeapMaintenance maintenance;
+
 
 };
 
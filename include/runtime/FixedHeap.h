@@ -4,7 +4,9 @@
 #include <iostream>
 #include "runtime/Heap.h"
 #include "system/FixedMemory.h"
+#include "misc/TraceRing.h"
 #include <vector>
+#include <cstring>
 
 using namespace std;
 
@@ -12,7 +14,7 @@ template <int N = 1>
 class FixedHeap:public Heap {
 public:
 	
-	FixedHeap(Memory& memory) : Heap(memory) {}
+	FixedHeap(Memory& memory) : memory(memory) {}
 
 	void initHeap() {
 		if (N <= 0) {
@@ -68,14 +70,14 @@ public:
 
 	//even -- false(0) = free blocks -- true(1) = used blocks
 	//odd -- false(0) = no relation -- true(1) = relation between blocks
-	void* alloc(size_t size) {
+	void* malloc(size_t size) {
 		if (getSize()) {
 			int numberofblocks = 0;
 			
 			if (size != 0) {
 				numberofblocks = size/N;
 			} else {
-				cerr << "Error: Please dont use a 0!" << endl;
+				traceEvent(TRACE_ZERO_ALLOC);
 				return nullptr;
 			}
 			
@@ -108,17 +110,82 @@ public:
 				}
 			}
 			
-			cerr << "Error: Your heap has not enough space left." << endl;
+			traceEvent(TRACE_OUT_OF_MEMORY, NULL, size);
 
 		} else {
-			cerr << "Error: Your heap is corrupted!" << endl;
+			traceEvent(TRACE_HEAP_CORRUPTED, this);
 		}
 
 		return nullptr;
 	}
 	
 
+	void* realloc(void* ptr, size_t size) {
+		if (ptr == NULL) {
+			return malloc(size);
+		} else if (size == 0) {
+			free(ptr);
+			return NULL;
+		}
+
+		size_t oldSize = getBlockBytes(ptr);
+		if (oldSize == 0) {
+			traceEvent(TRACE_REALLOC_NOT_A_BLOCK, ptr);
+			return NULL;
+		} else if (size <= oldSize) {
+			return ptr;
+		}
+
+		void* newPtr = malloc(size);
+		if (newPtr != NULL) {
+			memcpy(newPtr, ptr, oldSize);
+			free(ptr);
+		}
+		return newPtr;
+	}
+
+	void* calloc(size_t nmemb, size_t size) {
+		if (nmemb == 0 || size == 0) {
+			traceEvent(TRACE_ZERO_CALLOC, NULL, nmemb * size);
+			return nullptr;
+		} else if ((nmemb * size) / nmemb != size) {
+			traceEvent(TRACE_OUT_OF_MEMORY, NULL, nmemb * size);
+			return nullptr;
+		}
+
+		void* ptr = malloc(nmemb * size);
+		if (ptr != NULL) {
+			memset(ptr, 0, nmemb * size);
+		}
+		return ptr;
+	}
+
+	size_t getFreeBytes() {
+		size_t freeBlocks = 0;
+		for (int i = 0; i < getSize(); i += 2) {
+			if (!blocklist[i]) {
+				freeBlocks++;
+			}
+		}
+		return freeBlocks * N;
+	}
+
+	size_t getLargestFreeBlock() {
+		size_t largest = 0;
+		size_t count = 0;
+		for (int i = 0; i < getSize(); i += 2) {
+			count = blocklist[i] ? 0 : count + 1;
+			if (count > largest) {
+				largest = count;
+			}
+		}
+		return largest * N;
+	}
+
 	void free(void* address) {
+		if (address == NULL) {
+			return;
+		}
 		if (getSize()) {
 			char* start = (char*) (memory.getStart());
 			char* obj = (char*) address;
@@ -141,10 +208,10 @@ public:
 				
 				//If no matching block was found or it isn't the first element
 				if (count > getSize()-1) {
-					cerr << "Error: The address doesn't exist in the heap." << endl;
+					traceEvent(TRACE_FREE_OUT_OF_RANGE, address);
 					return;
 				} else if (blocklist[count-1] == 1) {
-					cerr << "Error: Please enter the first element of the memory blocks!" << endl;
+					traceEvent(TRACE_FREE_NOT_FIRST_BLOCK, address);
 					return;
 				}
 			}
@@ -155,11 +222,32 @@ public:
 				count++;
 			}
 		} else {
-			cerr << "Error: Your heap is corrupted!" << endl;
+			traceEvent(TRACE_HEAP_CORRUPTED, this);
 		}
 	}
 	
 private:
+	//bytes of the allocation that starts at address, 0 if no allocation starts there
+	size_t getBlockBytes(void* address) {
+		ptrdiff_t offset = ((char*) address) - ((char*) memory.getStart());
+		if (offset < 0 || offset % N != 0 || 2 * (offset / N) >= getSize()) {
+			return 0;
+		}
+
+		int i = (int) (2 * (offset / N));
+		if (!blocklist[i] || (i != 0 && blocklist[i-1])) {
+			return 0;
+		}
+
+		size_t count = 1;
+		while (i + 1 < getSize() && blocklist[i+1]) {
+			count++;
+			i += 2;
+		}
+		return count * N;
+	}
+
+	Memory& memory;
 	vector<bool> blocklist;
 };
 
@@ -43,6 +43,18 @@ public:
 
 	virtual void fillList(std::list<int>* list) = 0;
 
+	/**
+	 * @return number of free bytes in the heap
+	 */
+	virtual size_t getFreeBytes()=0;
+
+	/**
+	 * Together with getFreeBytes() this measures the external fragmentation.
+	 *
+	 * @return size of the largest free piece in bytes
+	 */
+	virtual size_t getLargestFreeBlock()=0;
+
 
 	//virtual list<tuple<size_t, bool>> getMemoryList()=0;
 
@@ -0,0 +1,66 @@
+/*
+ * HeapAllocator.h
+ *
+ * Classic STL allocator on top of a Heap, for containers without std::pmr:
+ *
+ * HeapAllocator<int> allocator(heap);
+ * std::vector<int, HeapAllocator<int>> numbers(allocator);
+ */
+
+#ifndef HeapAllocator_h
+#define HeapAllocator_h
+
+#include <new>
+#include <cstddef>
+#include "runtime/Heap.h"
+#include "runtime/MemoryResource.h"
+
+template <typename T>
+class HeapAllocator {
+public:
+	typedef T value_type;
+
+	/**
+	 * @param heapAlignment alignment of every pointer the heap returns, see HeapResource
+	 */
+	HeapAllocator(Heap& heap, size_t heapAlignment = sizeof(unsigned))
+		: heap(&heap), heapAlignment(heapAlignment) {}
+
+	template <typename U>
+	HeapAllocator(const HeapAllocator<U>& other)
+		: heap(other.heap), heapAlignment(other.heapAlignment) {}
+
+	T* allocate(size_t n) {
+		if (n > ((size_t) -1) / sizeof(T)) {
+			throw std::bad_array_new_length();
+		}
+		void* ptr = heapAllocateAligned(*heap, n == 0 ? 1 : n * sizeof(T), alignof(T), heapAlignment);
+		if (ptr == NULL) {
+			throw std::bad_alloc();
+		}
+		return (T*) ptr;
+	}
+
+	void deallocate(T* ptr, size_t n) {
+		heapFreeAligned(*heap, ptr, alignof(T), heapAlignment);
+	}
+
+	template <typename U>
+	bool operator==(const HeapAllocator<U>& other) const {
+		return heap == other.heap && heapAlignment == other.heapAlignment;
+	}
+
+	template <typename U>
+	bool operator!=(const HeapAllocator<U>& other) const {
+		return !(*this == other);
+	}
+
+private:
+	template <typename U>
+	friend class HeapAllocator;
+
+	Heap* heap;
+	size_t heapAlignment;
+};
+
+#endif
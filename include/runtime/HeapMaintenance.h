@@ -0,0 +1,44 @@
+/*
+ * HeapMaintenance.h
+ *
+ * Optional background worker for the FirstFitHeap.
+ * While it runs, free() only pushes first fit blocks onto a lock-free quick list.
+ * The worker periodically merges them into the free list (coalescing), gives
+ * the pages of large free blocks back to the virtual memory and releases spans
+ * that became empty, so this work is done on a low priority thread instead of
+ * in the request threads.
+ */
+
+#ifndef HeapMaintenance_h
+#define HeapMaintenance_h
+
+#include <atomic>
+#include "thread/Thread.h"
+
+class FirstFitHeap;
+
+class HeapMaintenance : public Thread
+{
+public:
+	HeapMaintenance(FirstFitHeap& heap) : heap(heap), intervalMicros(1000), stopping(false) {}
+
+	/**
+	 * @param intervalMicros time between two maintenance passes
+	 */
+	void setInterval(unsigned intervalMicros);
+
+	/**
+	 * Lets the worker finish its current pass and waits for it.
+	 * Unlike cancel() it never interrupts a pass that holds the heap lock.
+	 */
+	void stop();
+
+	void run();
+
+private:
+	FirstFitHeap& heap;
+	std::atomic<unsigned> intervalMicros;
+	std::atomic<bool> stopping;
+};
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * HeapProfile.h
+ *
+ * Compile-time build profiles for the allocator fast path.
+ * Select one with -DHEAP_PROFILE=HEAP_PROFILE_<NAME> (see bin/Makefile):
+ *
+ *   FAST     no validation at all on malloc/free/realloc
+ *   CHECKED  O(1) block canaries, catches double frees and corrupted headers
+ *   AUDIT    CHECKED plus bounds checks and a full heap walk on every free/realloc
+ *
+ * All checks are guarded by the constexpr flags below, so the disabled ones are
+ * removed by the compiler and every profile is built from the same code.
+ */
+
+#ifndef HeapProfile_h
+#define HeapProfile_h
+
+#define HEAP_PROFILE_FAST 0
+#define HEAP_PROFILE_CHECKED 1
+#define HEAP_PROFILE_AUDIT 2
+
+#ifndef HEAP_PROFILE
+	#define HEAP_PROFILE HEAP_PROFILE_FAST
+#endif
+
+//canary word behind the size of a block, only present in CHECKED and AUDIT
+#define BLOCK_CANARY_USED 0xA110CA7Eu
+#define BLOCK_CANARY_FREE 0xF4EEB10Cu
+
+template <int P>
+struct HeapProfileTraits;
+
+template <>
+struct HeapProfileTraits<HEAP_PROFILE_FAST> {
+	static constexpr bool canaries = false;
+	static constexpr bool boundsChecks = false;
+	static constexpr bool heapWalk = false;
+};
+
+template <>
+struct HeapProfileTraits<HEAP_PROFILE_CHECKED> {
+	static constexpr bool canaries = true;
+	static constexpr bool boundsChecks = false;
+	static constexpr bool heapWalk = false;
+};
+
+template <>
+struct HeapProfileTraits<HEAP_PROFILE_AUDIT> {
+	static constexpr bool canaries = true;
+	static constexpr bool boundsChecks = true;
+	static constexpr bool heapWalk = true;
+};
+
+typedef HeapProfileTraits<HEAP_PROFILE> HeapProfile;
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * LibcHeap.h
+ *
+ * The glibc allocator behind the Heap interface, the baseline for the benchmarks.
+ * malloc/free are replaced by Memalloc.cc in the whole program, so this class
+ * calls the __libc_* entry points of glibc directly.
+ */
+
+#ifndef LibcHeap_h
+#define LibcHeap_h
+
+#include <malloc.h>
+#include "runtime/Heap.h"
+
+extern "C" {
+	void* __libc_malloc(size_t size);
+	void* __libc_realloc(void* ptr, size_t size);
+	void* __libc_calloc(size_t nmemb, size_t size);
+	void __libc_free(void* ptr);
+}
+
+class LibcHeap : public Heap {
+public:
+	void* malloc(size_t size) {
+		return __libc_malloc(size);
+	}
+
+	void* realloc(void* ptr, size_t size) {
+		return __libc_realloc(ptr, size);
+	}
+
+	void* calloc(size_t nmemb, size_t size) {
+		return __libc_calloc(nmemb, size);
+	}
+
+	void free(void* address) {
+		__libc_free(address);
+	}
+
+	int getSize() {
+		return (int) mallinfo2().arena;
+	}
+
+	void fillList(std::list<int>* list) {
+	}
+
+	size_t getFreeBytes() {
+		return mallinfo2().fordblks;
+	}
+
+	//glibc doesn't report its largest free chunk, the top chunk is the best lower bound
+	size_t getLargestFreeBlock() {
+		return mallinfo2().keepcost;
+	}
+};
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * MemoryResource.h
+ *
+ * std::pmr::memory_resource implementations on top of the Memory and Heap
+ * interfaces, so containers can use a dedicated heap per subsystem without
+ * replacing malloc of the whole process:
+ *
+ *   MonotonicResource  bump pointer over a Memory, deallocate does nothing
+ *   HeapResource       any Heap, e.g. the FirstFitHeap
+ *   PoolResource<N>    a FixedHeap<N>, like std::pmr::unsynchronized_pool_resource
+ *                      it has no lock, so use one pool per thread or subsystem
+ *
+ * std::pmr::vector<int> numbers(&resource);
+ */
+
+#ifndef MemoryResource_h
+#define MemoryResource_h
+
+#include <memory_resource>
+#include <cstddef>
+#include <algorithm>
+#include "system/Memory.h"
+#include "runtime/Heap.h"
+#include "runtime/FixedHeap.h"
+
+/**
+ * Allocates bytes with the given alignment from the heap.
+ * If the heap doesn't guarantee the alignment, the block is larger and the
+ * pointer the heap returned is stored right in front of the aligned address.
+ *
+ * @param heapAlignment alignment of every pointer the heap returns
+ * @return aligned pointer or null if the heap is full
+ */
+void* heapAllocateAligned(Heap& heap, size_t bytes, size_t alignment, size_t heapAlignment);
+
+/**
+ * Frees a pointer of heapAllocateAligned(), alignment and heapAlignment must be the same.
+ */
+void heapFreeAligned(Heap& heap, void* ptr, size_t alignment, size_t heapAlignment);
+
+class MonotonicResource : public std::pmr::memory_resource
+{
+public:
+	/**
+	 * The memory must be initialized, the resource starts at memory.getStart().
+	 * If it is used up, the resource asks memory.expand() for more.
+	 */
+	MonotonicResource(Memory& memory);
+
+	/**
+	 * Makes the whole memory available again, all allocations become invalid.
+	 */
+	void release();
+
+	/**
+	 * @return bytes handed out since the construction or the last release()
+	 */
+	size_t getUsedBytes();
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment);
+
+	void do_deallocate(void* ptr, size_t bytes, size_t alignment);
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept;
+
+private:
+	Memory& memory;
+	char* current;
+	char* end;
+	size_t usedBytes;
+};
+
+class HeapResource : public std::pmr::memory_resource
+{
+public:
+	/**
+	 * @param heapAlignment alignment of every pointer the heap returns, larger
+	 *        alignments cost a bigger block. The FirstFitHeap only guarantees 4
+	 *        (the block header), the LibcHeap alignof(std::max_align_t).
+	 */
+	HeapResource(Heap& heap, size_t heapAlignment = sizeof(unsigned));
+
+	Heap& getHeap();
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment);
+
+	void do_deallocate(void* ptr, size_t bytes, size_t alignment);
+
+	//two resources over the same heap can free each others memory
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept;
+
+private:
+	Heap& heap;
+	size_t heapAlignment;
+};
+
+template <int N>
+class PoolResource : public HeapResource
+{
+public:
+	/**
+	 * The blocks of the heap are aligned to the lowest set bit of N, as long as
+	 * its memory is aligned to alignof(std::max_align_t) like FixedMemory's.
+	 */
+	PoolResource(FixedHeap<N>& heap)
+		: HeapResource(heap, std::min((size_t) (N & -N), alignof(std::max_align_t))) {}
+
+	size_t getBlockSize() {
+		return N;
+	}
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * PageMap.h
+ *
+ * Three level radix tree from a page number to the span that owns the page.
+ * It lets free() find the meta data of a small object without reading the
+ * memory next to it, so small objects don't need an in-band header.
+ * The inner nodes are allocated with mmap on demand, never with malloc,
+ * lookups are lock-free.
+ */
+
+#ifndef PageMap_h
+#define PageMap_h
+
+#include <sys/types.h>
+#include <atomic>
+
+//48 bit addresses, 4 KiB pages -> 36 bit page numbers, 12 bits per level
+#define PAGEMAP_PAGE_SHIFT 12
+#define PAGEMAP_PAGE_SIZE (1 << PAGEMAP_PAGE_SHIFT)
+#define PAGEMAP_BITS 12
+#define PAGEMAP_NODE_SIZE (1 << PAGEMAP_BITS)
+
+class FirstFitHeap;
+
+/**
+ * A span is a page aligned run of pages that is cut into objects of one size class.
+ */
+class Span {
+public:
+    void* start;            //first object of the span
+    void* block;            //heap block the span was carved from
+    unsigned pages;
+    unsigned sizeClass;     //object size in bytes
+    FirstFitHeap* arena;    //heap that owns the span
+    void* freeList;         //freed objects, linked through their first word
+    char* unused;           //objects behind this pointer were never handed out
+    unsigned usedObjects;
+    bool listed;            //the span is in the list of its size class
+    Span* next;             //spans of the same size class with free objects
+    Span* prev;
+};
+
+class PageMap {
+public:
+    /**
+     * @return the span that owns the page of the address, NULL if there is none
+     */
+    Span* get(const void* address);
+
+    /**
+     * Registers a span for all of its pages.
+     *
+     * @param start page aligned start address
+     * @param pages number of pages
+     * @param span the span, NULL removes the pages from the map
+     * @return false if a node of the tree couldn't be allocated
+     */
+    bool set(const void* start, size_t pages, Span* span);
+
+private:
+    struct Leaf {
+        std::atomic<Span*> spans[PAGEMAP_NODE_SIZE];
+    };
+    struct Node {
+        std::atomic<Leaf*> leaves[PAGEMAP_NODE_SIZE];
+    };
+
+    Leaf* getLeaf(size_t pageNumber, bool create);
+
+    std::atomic<Node*> root[PAGEMAP_NODE_SIZE] = {};
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define AddressMapping_h
 
 #include <sys/types.h>
+#include <cstdint>
 #include <iostream>
 #include <sys/mman.h>
 
@@ -15,46 +16,117 @@
 #define ACCESSED 1
 #define NO_LRU 0
 #define LRU 1
+#define NOT_READAHEAD 0
+#define READAHEAD 1
+#define NOT_SAME_FILLED 0
+#define SAME_FILLED 1
+
+//an address is split into 4 table indices of 9 bits and the offset of 12 bits, 48 bits in all
+#define TABLE_LEVELS 4
+#define TABLE_INDEX_BITS 9
+#define TABLE_ENTRIES (1 << TABLE_INDEX_BITS)
+#define PAGE_OFFSET_BITS 12
+#define ADDRESS_BITS (TABLE_LEVELS * TABLE_INDEX_BITS + PAGE_OFFSET_BITS)
+
+//the flags are the lower 12 bits, the frame (or the swap slot of a page that is not present) the upper ones
+typedef uint64_t table_entry;
 
 using namespace std;
 
+/*
+ * The tables are pages of the table area in front of the data pages, the root is
+ * the first one. An entry of a table holds the page of the table of the next level
+ * in the table area, an entry of the last level the frame of a data page. Tables
+ * are added when the first page they map is used. The pages of the table area
+ * aren't described by the tables, their entries are an array of their own: a
+ * table that maps no resident page can be evicted like a data page, the walk
+ * to a page stops at it until it is loaded again.
+ */
 class AddressMapping {
 public:
-     unsigned logAddr2PF(unsigned* virtualMemStart, unsigned* logAddr);
+     /**
+      * @param tables table area, the root is its first page
+      * @param tablePages entries of the pages of the table area
+      * @param start first data page, addresses are translated relative to it
+      */
+     void setLayout(char* tables, table_entry* tablePages, char* start);
+
+     /**
+      * @return number of tables that map the pages, including the root
+      */
+     static size_t tablesFor(size_t pages);
+
+     table_entry logAddr2PF(void* logAddr);
+
+     /**
+      * @return the entry of the page, 0 if a table on the way to it is missing or evicted
+      */
+     table_entry* logAddr2PTEntryAddr(void* logAddr);
+
+     /**
+      * @return the entry that has to point to the next missing table on the way to the page,
+      * 0 if there is none or an evicted table comes first
+      */
+     table_entry* missingTableEntry(void* logAddr);
+
+     /**
+      * @return the first evicted table on the way to the page, 0 if there is none before a missing one
+      */
+     size_t evictedTable(void* logAddr);
+
+     /**
+      * @return the table that holds the entry of the data page, 0 if it is missing or evicted
+      */
+     size_t pageTableOf(void* logAddr);
+
+     size_t phyAddr2page(size_t logaddr);
+
+     /**
+      * @param level 0 is the last level, TABLE_LEVELS - 1 the root
+      */
+     unsigned phyAddr2TableIndex(size_t logaddr, unsigned level);
+
+     unsigned cutOfOffset(table_entry entry);
 
-     unsigned* logAddr2PTEntryAddr(unsigned* virtualMemStart, unsigned* logAddr);
+     unsigned createOffset(bool presentBit, bool read_writeBit, bool accessed, bool pinnedBit, bool lruBit);
 
-     unsigned phyAddr2page(unsigned logaddr);
+     unsigned getPresentBit(table_entry phyAddr);
 
-     unsigned phyAddr2PDIndex(unsigned page);
+     void setPresentBit(table_entry* tableEntry, bool presentBit);
 
-     unsigned phyAddr2PTIndex(unsigned page);
+     unsigned getReadAndWriteBit(table_entry phyAddr);
 
-     unsigned cutOfOffset(unsigned logaddr);
+     void setReadAndWriteBit(table_entry* tableEntry, bool read_writeBit);
 
-     unsigned createOffset(bool presentBit, bool read_writeBit, bool accessed, bool pinnedBit, bool lruBit);
+     unsigned getAccessed(table_entry phyAddr);
 
-     unsigned getPresentBit(unsigned phyAddr);
+     void setAccessed(table_entry* tableEntry, bool accessed);
 
-     void setPresentBit(unsigned* tableEntry, bool presentBit);
+     unsigned getPinnedBit(table_entry phyAddr);
 
-     unsigned getReadAndWriteBit(unsigned phyAddr);
+     void setPinnedBit(table_entry* tableEntry, bool pinnedBit);
 
-     void setReadAndWriteBit(unsigned* tableEntry, bool read_writeBit);
+     unsigned getLruBit(table_entry phyAddr);
 
-     unsigned getAccessed(unsigned phyAddr);
+     void setLruBit(table_entry* tableEntry, bool lruBit);
 
-     void setAccessed(unsigned* tableEntry, bool accessed);
+     unsigned getReadaheadBit(table_entry phyAddr);
 
-     unsigned getPinnedBit(unsigned phyAddr);
+     void setReadaheadBit(table_entry* tableEntry, bool readaheadBit);
 
-     void setPinnedBit(unsigned* tableEntry, bool pinnedBit);
+     unsigned getSameFilledBit(table_entry phyAddr);
 
-     unsigned getLruBit(unsigned phyAddr);
-
-     void setLruBit(unsigned* tableEntry, bool lruBit);
+     void setSameFilledBit(table_entry* tableEntry, bool sameFilledBit);
 
      int fd;
+
+private:
+     char* tables = NULL;
+     table_entry* tablePages = NULL;
+     char* start = NULL;
+
+     table_entry* tableOf(table_entry entry);
+     bool isResident(table_entry entry);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*
+ * CompressedSwap.h
+ *
+ * Compressed swap tier in RAM in front of the swap file, like zswap. An evicted
+ * page is compressed into a pool, a page that doesn't shrink to 3/4 of its size
+ * or doesn't fit in the budget any more goes to the swap file. A page in the
+ * pool is decompressed instead of read.
+ *
+ * The tier holds the content of pages that are clean: a page keeps its copy
+ * while it is resident and only loses it when it gets dirty, so evicting it
+ * clean again costs nothing. The copy in the pool shadows an older one on the
+ * swap file.
+ *
+ * The pool is one mapping of the budget. Objects are rounded up to granules of
+ * 64 bytes, a freed object goes to the free list of its size class and the
+ * rest of the pool is handed out from the front. All memory is mapped when the
+ * tier is created, it is used in the fault handler.
+ */
+
+#ifndef CompressedSwap_h
+#define CompressedSwap_h
+
+#include <cstddef>
+#include <sys/types.h>
+#include "misc/PageCompressor.h"
+
+#define COMPRESSED_GRANULE 64
+
+struct CompressedPage
+{
+	unsigned offset;    //in the pool
+	unsigned length;    //of the compressed data, 0 if the page is not in the pool
+};
+
+class CompressedSwap
+{
+public:
+	/**
+	 * @param budget bytes of the pool, 0 disables the tier
+	 * @param pages number of pages that can be stored
+	 * @return false if the mappings failed, the tier stays disabled
+	 */
+	bool create(size_t budget, size_t pageSize, size_t pages);
+
+	void destroy();
+
+	bool isEnabled();
+
+	/**
+	 * Stores the content of the page, a copy stored before is replaced.
+	 *
+	 * @return false if the page has to go to the swap file
+	 */
+	bool store(size_t page, const char *content);
+
+	/**
+	 * Decompresses the page, its copy stays in the pool.
+	 *
+	 * @return false if the page is not in the pool
+	 */
+	bool load(size_t page, char *content);
+
+	bool contains(size_t page);
+
+	/**
+	 * The page got dirty, its copy is outdated.
+	 */
+	void drop(size_t page);
+
+	/**
+	 * Forgets all pages.
+	 */
+	void reset();
+
+private:
+	size_t budget = 0;
+	size_t pageSize = 0;
+	size_t pages = 0;
+	size_t classes = 0;
+
+	char *pool = NULL;
+	size_t poolUsed = 0;            //front of the pool that was handed out
+	unsigned *freeLists = NULL;     //per size class, the offset of the first free object + 1
+	CompressedPage *directory = NULL;
+	char *scratch = NULL;
+	PageCompressor compressor;
+
+	size_t sizeClass(size_t length);
+	bool allocate(size_t length, unsigned *offset);
+	void release(CompressedPage& entry);
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * FaultLock.h
+ *
+ * Lock of the VirtualMem. A fault on a present data page only changes the
+ * entry of its page and takes the lock shared, so threads that fault on
+ * different pages run in parallel. Everything that maps pages in or out, lets
+ * the policy decide or changes the tables takes it exclusive, also across the
+ * swap file I/O of a swap-in, so major faults don't run in parallel. Writers
+ * are preferred, a stream of minor faults can't starve an eviction.
+ *
+ * The lock is taken in the SIGSEGV handler before the globals are constructed,
+ * so it is initialized statically. The threads holding it are known, exclusive
+ * or shared: a fault of such a thread would wait for itself (the rwlock is not
+ * recursive and prefers the writers) and is reported instead.
+ */
+
+#ifndef FaultLock_h
+#define FaultLock_h
+
+#include <atomic>
+#include <pthread.h>
+
+class FaultLock
+{
+public:
+	constexpr FaultLock() {}
+
+	void lock();
+	void unlock();
+	void lock_shared();
+	void unlock_shared();
+
+	/**
+	 * @return true if the calling thread holds the lock exclusive or shared
+	 */
+	bool heldByCaller();
+
+private:
+	pthread_rwlock_t rwlock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+	std::atomic<bool> owned{false};
+	std::atomic<pthread_t> owner{0};
+};
+
+#endif
@@ -6,7 +6,7 @@
 template <int M>
 class FixedMemory:public Memory {
 public:
-	FixedMemory() {}
+	FixedMemory() : memblock(NULL) {}
 
 	void initMem() {
 		this -> memblock = malloc(M);
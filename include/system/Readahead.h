@@ -0,0 +1,70 @@
+/*
+ * Readahead.h
+ *
+ * Detects sequential and constant-stride fault patterns. A stream remembers
+ * the last page it saw and the stride to the one before. When a fault
+ * continues the stride, the VirtualMem reads the next window pages ahead.
+ * The window doubles each time the pages read ahead were used up and halves
+ * when one of them is evicted without being used.
+ *
+ * Pages are numbered from the start of the data area. Streams are found by the
+ * page they predict or by their region (512 pages, as many as a page table
+ * maps), so several scans can run at the same time.
+ */
+
+#ifndef Readahead_h
+#define Readahead_h
+
+#include <sys/types.h>
+#include "system/AddressMapping.h"
+
+#define READAHEAD_STREAMS 8
+#define READAHEAD_MIN_WINDOW 4
+#define READAHEAD_MAX_WINDOW 32
+//larger strides are not followed, the pages would rarely be used
+#define READAHEAD_MAX_STRIDE 16
+#define READAHEAD_REGION_SHIFT TABLE_INDEX_BITS
+
+struct ReadaheadStream
+{
+    size_t region;
+    long lastPage;
+    long stride;          //0 until a second fault in the region
+    unsigned window;
+    bool issued;          //pages were read ahead for the current stride
+    bool used;            //false for a free slot
+};
+
+class Readahead
+{
+public:
+    Readahead();
+
+    /**
+     * @param page the missing page
+     * @param stride the stride of the stream, in pages
+     * @return number of pages to read ahead, 0 if the fault has no pattern
+     */
+    unsigned onMiss(long page, long *stride);
+
+    /**
+     * First use of a page read ahead: the stream continues behind it.
+     */
+    void onHit(long page);
+
+    /**
+     * A page read ahead was evicted before it was used.
+     */
+    void onUnused(long page);
+
+    void reset();
+
+private:
+    ReadaheadStream streams[READAHEAD_STREAMS];
+    unsigned nextStream;
+
+    //the stream that read the page ahead or NULL
+    ReadaheadStream *predicting(long page);
+};
+
+#endif
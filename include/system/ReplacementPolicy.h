@@ -0,0 +1,181 @@
+/*
+ * ReplacementPolicy.h
+ *
+ * Decides which data page the VirtualMem evicts. The VirtualMem reports
+ *
+ *   onFault      a page was mapped in
+ *   onAccess     a resident page was referenced again
+ *   onEvict      the victim left the memory
+ *   onDiscard    the heap freed the page, it is forgotten without a ghost
+ *
+ * and asks chooseVictim() when it needs a frame. References are sampled: a
+ * reported page is made PROT_NONE again before the next victim is chosen, so
+ * onAccess is called at most once per page between two evictions.
+ *
+ *   REPLACE_FIFO   oldest page
+ *   REPLACE_CLOCK  second chance, near LRU without moving pages on a reference
+ *   REPLACE_LRU    least recently referenced page
+ *   REPLACE_2Q     new pages wait in a FIFO, only a reference there or a fault
+ *                  of a page remembered from it promotes into the LRU part
+ *   REPLACE_ARC    adapts the size of the recency and the frequency list to the
+ *                  hits of their ghost lists (Megiddo & Modha)
+ *
+ * 2Q and ARC keep a scan from pushing the hot pages out.
+ * The lists are PageLists, every operation of a policy is O(1) but the CLOCK sweep.
+ * The policies don't allocate after create(), they are used in the fault handler.
+ */
+
+#ifndef ReplacementPolicy_h
+#define ReplacementPolicy_h
+
+#include <sys/types.h>
+#include "misc/PageList.h"
+
+enum replacement_policy : int
+{
+	REPLACE_FIFO,
+	REPLACE_CLOCK,
+	REPLACE_LRU,
+	REPLACE_2Q,
+	REPLACE_ARC
+};
+
+class ReplacementPolicy
+{
+public:
+	/**
+	 * @param capacity data pages that fit in the memory, the 2Q and ARC lists are sized by it
+	 * @param start, pageSize, pages the area of the data pages
+	 * @return the policy in its own mapping or NULL if the mmap failed
+	 */
+	static ReplacementPolicy *create(replacement_policy type, unsigned capacity, void *start, size_t pageSize, size_t pages);
+
+	static void destroy(ReplacementPolicy *policy);
+
+	/**
+	 * @return the policy named fifo, clock, lru, 2q or arc, the default for other names
+	 */
+	static replacement_policy fromName(const char *name, replacement_policy defaultPolicy);
+
+	virtual ~ReplacementPolicy() {}
+
+	virtual void onFault(void *page) = 0;
+
+	virtual void onAccess(void *page) = 0;
+
+	/**
+	 * @param faultingPage page the frame is needed for, NULL if the eviction has another reason
+	 * @return resident page to evict, it stays resident until onEvict()
+	 */
+	virtual void *chooseVictim(void *faultingPage) = 0;
+
+	virtual void onEvict(void *page) = 0;
+
+	/**
+	 * The content of the page was given up, it may be resident or not.
+	 * A fault on it later is no hit of a ghost list.
+	 */
+	virtual void onDiscard(void *page);
+
+	/**
+	 * Forgets all pages, the memory was discarded.
+	 */
+	virtual void reset() = 0;
+
+	virtual void setCapacity(unsigned capacity);
+
+	virtual size_t getResidentCount() = 0;
+
+protected:
+	unsigned capacity = 0;
+	PageLinks links;
+
+private:
+	size_t mappedSize = 0;
+};
+
+class FifoPolicy : public ReplacementPolicy
+{
+public:
+	void onFault(void *page);
+	void onAccess(void *page);
+	void *chooseVictim(void *faultingPage);
+	void onEvict(void *page);
+	void reset();
+	size_t getResidentCount();
+
+private:
+	PageList pages{links, 1};
+};
+
+class ClockPolicy : public ReplacementPolicy
+{
+public:
+	void onFault(void *page);
+	void onAccess(void *page);
+	void *chooseVictim(void *faultingPage);
+	void onEvict(void *page);
+	void reset();
+	size_t getResidentCount();
+
+private:
+	//the front is the clock hand, the mark of the links is the reference bit
+	PageList pages{links, 1};
+};
+
+class LruPolicy : public ReplacementPolicy
+{
+public:
+	void onFault(void *page);
+	void onAccess(void *page);
+	void *chooseVictim(void *faultingPage);
+	void onEvict(void *page);
+	void reset();
+	size_t getResidentCount();
+
+private:
+	//least recently referenced page at the front
+	PageList pages{links, 1};
+};
+
+class TwoQueuePolicy : public ReplacementPolicy
+{
+public:
+	void onFault(void *page);
+	void onAccess(void *page);
+	void *chooseVictim(void *faultingPage);
+	void onEvict(void *page);
+	void onDiscard(void *page);
+	void reset();
+	size_t getResidentCount();
+
+private:
+	PageList recent{links, 1};       //A1in, FIFO of the new pages
+	PageList evicted{links, 2};      //A1out, pages evicted from recent, without a frame
+	PageList frequent{links, 3};     //Am, LRU of the pages referenced again
+	unsigned recentSize();
+	unsigned evictedSize();
+};
+
+class ArcPolicy : public ReplacementPolicy
+{
+public:
+	void onFault(void *page);
+	void onAccess(void *page);
+	void *chooseVictim(void *faultingPage);
+	void onEvict(void *page);
+	void onDiscard(void *page);
+	void reset();
+	void setCapacity(unsigned capacity);
+	size_t getResidentCount();
+
+private:
+	PageList recent{links, 1};           //T1, pages referenced once
+	PageList frequent{links, 2};         //T2, pages referenced at least twice
+	PageList recentGhosts{links, 3};     //B1, evicted from T1
+	PageList frequentGhosts{links, 4};   //B2, evicted from T2
+	unsigned target = 0;    //p, the size T1 aims for
+	void trimGhosts();
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * SwapSlots.h
+ *
+ * Allocator of the page sized slots of the swap file. A page gets a slot when
+ * its content has to be written and gives it back when the content is outdated,
+ * so the swap file only grows to the number of pages that are on it at the same
+ * time and not to the size of the virtual memory.
+ *
+ * The slots are a bitmap, one word of it is a cluster of 64 slots. Allocations
+ * continue in the cluster of the last one, so pages that are evicted one after
+ * the other land in consecutive slots and are written and read ahead in order.
+ * A full cluster is followed by the lowest empty one. If there is none, the
+ * file grows by a cluster while its used part is at least 3/4 full, otherwise
+ * the free slots between used ones are taken. Slot 0 is never handed out, it
+ * stands for no slot. All memory is mapped when the allocator is created, it is
+ * used in the fault handler.
+ */
+
+#ifndef SwapSlots_h
+#define SwapSlots_h
+
+#include <cstddef>
+#include <sys/types.h>
+
+#define SWAP_NO_SLOT 0
+#define SWAP_CLUSTER_SLOTS 64
+
+class SwapSlots
+{
+public:
+	/**
+	 * @param slots number of slots, including slot 0
+	 * @return false if the mapping failed
+	 */
+	bool create(size_t slots);
+
+	void destroy();
+
+	/**
+	 * @param emptyCluster set if no other slot of the cluster is used
+	 * @return the slot, SWAP_NO_SLOT if all slots are used
+	 */
+	unsigned allocate(bool *emptyCluster);
+
+	/**
+	 * @return true if no slot of the cluster is used any more
+	 */
+	bool release(unsigned slot);
+
+	/**
+	 * Frees all slots.
+	 */
+	void reset();
+
+private:
+	size_t slots = 0;
+	size_t words = 0;
+	unsigned long *bitmap = NULL;   //a set bit is a used slot
+	size_t cursor = 0;              //slot after the last allocation
+	size_t emptyHint = 0;           //all clusters below it are used
+	size_t used = 0;                //slots handed out, including slot 0
+	size_t top = 0;                 //clusters the swap file extends over
+
+	unsigned allocateSlot();
+	unsigned take(size_t slot);
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * UserFaultEngine.h
+ *
+ * Paging engine driven by userfaultfd. The data pages of the VirtualMem are
+ * registered for missing and write-protect faults. The faulting thread sleeps
+ * in the kernel while this thread resolves the fault with UFFDIO_COPY, so no
+ * signal is delivered and no page is remapped.
+ * Clean pages are mapped write protected, their first write is reported
+ * as a write-protect fault and marks them dirty.
+ */
+
+#ifndef UserFaultEngine_h
+#define UserFaultEngine_h
+
+#include <atomic>
+#include <sys/types.h>
+#include "thread/Thread.h"
+
+class VirtualMem;
+
+class UserFaultEngine : public Thread
+{
+public:
+	UserFaultEngine(VirtualMem& memory) : memory(memory) {}
+
+	/**
+	 * Opens the userfaultfd, registers the range and starts the thread.
+	 *
+	 * @param bufferPages size of the buffer, the most pages one copyPages() maps
+	 * @return false if userfaultfd is not available, the signal engine has to do the paging then
+	 */
+	bool start(void *start, size_t length, size_t pageSize, size_t bufferPages);
+
+	/**
+	 * Registers the range again, a new mapping over it drops the registration.
+	 */
+	bool registerRange(void *start, size_t length);
+
+	void stop();
+
+	bool isRunning();
+
+	/**
+	 * @return true if clean pages can be write protected, otherwise all pages count as dirty
+	 */
+	bool tracksWrites();
+
+	/**
+	 * Memory to prepare the content of copyPage() and copyPages().
+	 */
+	char *getBuffer();
+
+	/**
+	 * Maps a page with the content of the buffer and wakes the faulting threads.
+	 *
+	 * @param writeProtect the next write to the page is reported
+	 */
+	void copyPage(void *page, bool writeProtect);
+
+	/**
+	 * Maps adjacent pages with the content of the source, a part of the buffer.
+	 *
+	 * @return number of pages from start on that are mapped
+	 */
+	size_t copyPages(void *start, char *source, size_t pages, bool writeProtect);
+
+	/**
+	 * Allows writes to a write protected page and wakes the faulting threads.
+	 */
+	void unprotect(void *page);
+
+	/**
+	 * Write protects a mapped page, its next write is reported again.
+	 *
+	 * @return false if the page can't be protected, it has to stay dirty then
+	 */
+	bool protect(void *page);
+
+	/**
+	 * Drops the content of adjacent pages, the next access is a missing fault again.
+	 */
+	void dropPages(void *start, size_t pages);
+
+	void wake(void *page);
+
+	void run();
+
+private:
+	VirtualMem& memory;
+	int uffd = -1;
+	//written by stop() to interrupt the poll
+	int wakeFd = -1;
+	size_t pageSize = 0;
+	size_t bufferPages = 0;
+	bool writeProtection = false;
+	bool started = false;
+	std::atomic<bool> stopping{false};
+	char *buffer = NULL;
+	char *stack = NULL;
+};
+
+#endif
@@ -3,7 +3,14 @@
 #include "system/Memory.h"
 #include "system/AddressMapping.h"
 #include "misc/SwapFile.h"
-#include "misc/AccessQueue.h"
+#include "misc/UringSwapFile.h"
+#include "system/ReplacementPolicy.h"
+#include "system/Readahead.h"
+#include "system/UserFaultEngine.h"
+#include "system/WriteBack.h"
+#include "system/CompressedSwap.h"
+#include "system/SwapSlots.h"
+#include "system/FaultLock.h"
 #include <iostream>
 #include <signal.h>
 #include <list>
@@ -28,55 +35,268 @@ enum permission_change : int
     LRU_CASE_WRITE
 };
 
+enum paging_engine : int
+{
+    PAGING_SIGNAL,      //SIGSEGV handler and mprotect/mmap per page
+    PAGING_USERFAULT    //userfaultfd thread, falls back to PAGING_SIGNAL if it is not available
+};
+
+enum dirty_tracking : int
+{
+    DIRTY_PROTECTION,   //clean pages are read only, their first write faults again
+    DIRTY_PAGEMAP       //pages are writable right away, /proc/self/pagemap tells which ones were written
+};
+
+//what the access of a fault on a present page was, as far as the CPU tells
+enum fault_access : int
+{
+    ACCESS_READ,
+    ACCESS_WRITE,
+    ACCESS_UNKNOWN      //a read that was fixed by another thread meanwhile is retried once
+};
+
+//the frame tables are mapped for this many frames, 64 GiB of 4 KiB pages
+#define MAX_FRAMES (1 << 24)
+//the policies and the swap slots number the data pages with 32 bits
+#define MAX_VIRTUAL_SIZE (1ull << 43)
+//locks that serialize the faults on the same page under the shared FaultLock
+#define PAGE_LOCK_STRIPES 64
+//the tables on the way to a page and the two data pages one instruction can use
+#define MIN_FRAMES (TABLE_LEVELS + 2)
+
+/**
+ * Settings of the simulated physical memory.
+ */
+struct VirtualMemConfig
+{
+    //the page tables take frames as well, a table that maps no resident page is evicted before
+    //a data page, so the data pages get at least 2 frames. At least MIN_FRAMES
+    unsigned frames;        //page frames of the physical memory
+    size_t pageSize;        //0 is the page size of the system
+    bool writeBackAll;      //write every evicted page to the swap file, not only the dirty ones
+    paging_engine engine;
+    replacement_policy replacement;
+    unsigned writeBackThreads;  //threads that clean dirty pages before they are evicted, 0 for none
+    size_t compressedSwap;      //bytes of the compressed swap tier in RAM, 0 for none
+    size_t swapExtent;          //bytes of the swap file that are reserved at once, 0 to allocate them on write
+    dirty_tracking dirtyTracking;   //only for the signal engine, the userfault engine write protects clean pages
+    size_t virtualSize;         //bytes of the data pages, the tables for them are reserved in front
+
+    VirtualMemConfig() : frames(10), pageSize(0), writeBackAll(false), engine(PAGING_SIGNAL), replacement(REPLACE_CLOCK),
+        writeBackThreads(1), compressedSwap(16 << 20), swapExtent(4 << 20), dirtyTracking(DIRTY_PROTECTION),
+        virtualSize(1ull << 32) {}
+
+    /**
+     * Defaults overridden by MEMALLOC_FRAMES, MEMALLOC_PAGE_SIZE, MEMALLOC_WRITE_BACK_ALL,
+     * MEMALLOC_ENGINE (signal or userfault), MEMALLOC_REPLACEMENT (fifo, clock, lru, 2q or arc),
+     * MEMALLOC_WRITE_BACK_THREADS, MEMALLOC_COMPRESSED_SWAP, MEMALLOC_SWAP_EXTENT,
+     * MEMALLOC_DIRTY_TRACKING (protection or pagemap) and MEMALLOC_VIRTUAL_SIZE, the only way
+     * to configure the memory of the preloaded library.
+     */
+    static VirtualMemConfig fromEnvironment();
+};
+
 class VirtualMem: public Memory
 {
 private:
     
     ///////////////////////////////////////////
-    unsigned *virtualMemStartAddress = NULL;
-    unsigned nextFreeFrameIndex = 0;
+    //the table area, the data pages follow it
+    char *virtualMemStartAddress = NULL;
+    size_t pageSize = 0;
+    size_t virtualSize = 0;
+    //pages of the table area and the entries of them, tables are handed out from the front
+    size_t tableCount = 0;
+    size_t usedTables = 0;
+    table_entry *tablePages = NULL;
+    //per table, the table whose entry points to it and how many tables or data pages it maps are resident
+    unsigned *tableParents = NULL;
+    unsigned short *tableResidents = NULL;
+    //tables that map no resident page, in the order they became idle; a table is queued once
+    unsigned *idleTables = NULL;
+    bool *idleQueued = NULL;
+    size_t idleHead = 0;
+    size_t idleCount = 0;
+    bool writeBackAll = false;
 
-    unsigned pageoutPointer = 0;
     unsigned numberOfPF = 0 ;
+    //stack of the unused frames
+    unsigned *freeFrames = NULL;
+    unsigned freeFrameCount = 0;
+    //page that is mapped to a frame, NULL for a free frame
+    void **framePages = NULL;
+    //swap slot of the page in a frame, a page that is not present has it in its entry
+    unsigned *frameSlots = NULL;
+    //one page, used to move a page to another frame
+    char *relocationBuffer = NULL;
+    //a shared mapping of all frames, pages are loaded through it. With pagemap tracking
+    //a page that is copied on write in its private mapping was written
+    char *frameMemory = NULL;
+    int pagemapFd = -1;
+    //data pages reported to the policy since the last eviction, they are still accessible
+    void **referencedPages = NULL;
+    unsigned referencedCount = 0;
+    //victims of evictPages(), they are mapped out together
+    void **evictedPages = NULL;
+    ReplacementPolicy *policy = NULL;
+    Readahead readahead;
     
     int fd = 0; 
     AddressMapping mappingUnit;
     size_t pinnedPages = 0;
     SwapFile swapFile;
+    //batched transfers of the fault path, the single ones use the swapFile
+    UringSwapFile swapQueue;
+    UserFaultEngine userFaults{*this};
+    WriteBack writeBack{*this};
+    CompressedSwap compressedSwap;
+    SwapSlots swapSlots;
+    //the swap file is reserved up to swapReserved, the next extent when half of the last one is used
+    size_t swapExtent = 0;
+    off_t swapReserved = 0;
+    //the file system can punch holes for clusters that are not used any more
+    bool punchHoles = true;
+    //per data page, the word a page with the SAME_FILLED bit is filled with
+    unsigned long *fillWords = NULL;
+    //next frame cleanColdPages() looks at
+    unsigned cleanCursor = 0;
+    //faults under the shared lock: the stripe of the page guards its entry, minorFaultMutex
+    //the policy, the readahead and the swap metadata they share with each other
+    std::mutex pageLocks[PAGE_LOCK_STRIPES];
+    std::mutex minorFaultMutex;
+
+    void resetFrames();
+    unsigned allocFrame();
+    void evictPage(void *faultingPage);
+    void evictPages(size_t count);
+    bool evictColdPage();
+    void detachPage(void *page);
+    void reportAccess(void *pageStartAddr, table_entry *pageTableEntry);
+    void readAhead(void *pageStartAddr);
+    size_t queueReadAheadRun(char *start, size_t pages, size_t bufferPage);
+    void mapReadAheadRun(char *start, size_t pages, size_t bufferPage);
+    long pageNumber(void *page);
+    unsigned pageSlot(table_entry *pageTableEntry);
+    bool pageWritten(void *page);
+    bool isDirty(void *page, table_entry *pageTableEntry);
+    char *loadAddress(void *page, table_entry *pageTableEntry);
+    void clearNewPage(void *page);
+    unsigned allocateSlot();
+    void releaseSlot(table_entry *pageTableEntry);
+    void releaseSwapSlot(unsigned slot);
+    void discardRun(char *start, size_t pages);
+    off_t slotOffset(unsigned slot);
+    void markDirty(void *page, table_entry *pageTableEntry);
+    bool storeWithoutIo(void *page, table_entry *pageTableEntry);
+    bool loadWithoutIo(void *page, table_entry *pageTableEntry, char *content);
+    void referencePage(void *pageStartAddr);
+    void protectReferencedPages();
+    void relocatePage(unsigned fromFrame, unsigned toFrame);
+    void addTables(void *page);
+    size_t parentTable(void *page);
+    void residentRemoved(size_t table);
+    bool evictIdleTable(size_t keepTable);
+    void loadTable(size_t table);
+    void keepDataFrames();
     
 public:
     unsigned pagesinRAM = 0;
-    Queue accessQueue;
-    bool LRU_running = false;
     /////////////////////////////////////////////////
     // Signal handeler, constructor and deconstructor.
     // static void signalHandeler(int SigNumber, siginfo_t *info, void *ucontext);
     // VirtualMem(size_t chunkSize, size_t chunksNumber, size_t blockSize, size_t maxChunksAvailable, bool writeBackAll);
-    VirtualMem();
+    VirtualMem(const VirtualMemConfig& config = VirtualMemConfig());
     ~VirtualMem();
     /////////////////////////////////////////////////
+    // Configuration
+    /**
+     * Discards the whole content of the memory and starts with empty page tables.
+     * Only for programs that use the VirtualMem directly, the FirstFitHeap lives in it.
+     */
+    void initializeVirtualMem(bool writeBackAll);
+    /**
+     * Evicts all data pages, so the next run starts without resident pages.
+     * The content stays valid, it is read from the swap file again.
+     */
+    void resetQueues();
+    /**
+     * Changes the number of page frames. Shrinking evicts pages and idle page tables down
+     * to the new size and moves pages out of the frames that are dropped, growing extends the shm file.
+     *
+     * @return false if the budget is below MIN_FRAMES
+     */
+    bool setFrameBudget(unsigned frames);
+    unsigned getFrameBudget();
+    size_t getPageSize();
+    /**
+     * @return true if the userfaultfd engine does the paging
+     */
+    bool usesUserFaults();
+    /////////////////////////////////////////////////
     // Basic Methods
     void *getStart();
     size_t getSize();
     void *expand(size_t size);
+    /**
+     * Gives the whole pages of the range back, the heap freed them. Resident pages
+     * are mapped out without a write, their frames are free again. The slots, the
+     * compressed copies and the fill words of the pages are released, the pages
+     * are new ones again and read as zeros.
+     */
+    void discard(void *start, size_t bytes);
     /////////////////////////////////////////////////
     // Advanced Methods
     void fixPermissions(void *);
-    void* kickPageFromStack();
-    void initializePDandFirstPT();
-    void addPageEntry2PT(unsigned *pageStartAddress);
-    void addPTEntry2PD(unsigned *startAddrPage);
+    /**
+     * Resolves a fault on a present data page, the caller holds the lock shared.
+     *
+     * @param access faults of several threads on the same page are fixed one after the other,
+     * a read that finds the page readable already only has to be repeated
+     * @return false if the fault needs fixPermissions() under the exclusive lock
+     */
+    bool fixPresentPage(void *address, fault_access access);
+    /**
+     * Resolves a fault the userfaultfd engine read.
+     *
+     * @param write the access was a write
+     * @param writeProtect first write to a clean page
+     */
+    void userFault(void *address, bool write, bool writeProtect);
+    /**
+     * Copies dirty pages that were not used since the last sampling into slots of
+     * the write-back and marks them clean, called by the write-back workers.
+     *
+     * @return number of pages copied, 0 if no page is left or all slots are in flight
+     */
+    size_t cleanColdPages();
+    /**
+     * Asks the replacement policy for the page to evict and marks it not present.
+     *
+     * @param faultingPage page the frame is needed for, NULL if there is none
+     */
+    void* kickPageFromStack(void *faultingPage);
+    void initializeRootTable();
+    void addPageEntry2PT(void *pageStartAddress, unsigned frame);
+    /**
+     * Maps in a new table and lets the entry point to it.
+     * The table that holds the entry has to be resident.
+     */
+    void addTable(table_entry *entry);
     void *findStartAddress(void *ptr);
     void readPageActivate(void *ptr);
     void writePageActivate(void *ptr);
     void pageOut(void *ptr);
     void pageIn(void *ptr);
-    void mapOut(void *pageStartAddress);
-    void mapIn(void *pageStartAddress);
-    void protNoneAll();
+    /**
+     * Frees the frames of adjacent pages, one syscall for all of them.
+     */
+    void mapOut(void *pageStartAddress, size_t pages = 1);
+    /**
+     * Gives adjacent pages a frame each, runs of consecutive frames are mapped with one mmap.
+     */
+    void mapIn(void *pageStartAddress, size_t pages = 1);
 };
 
 extern VirtualMem vMem;
-void runLRUTimer();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+/*
+ * WriteBack.h
+ *
+ * Background write-back of dirty pages. When an eviction had to write its
+ * victim, the workers ask the VirtualMem to clean the pages that were not used
+ * since the last sampling, the likely next victims. Under the VirtualMem lock
+ * such a page is write protected, copied into a slot and marked clean, a later
+ * write marks it dirty again. The slot is written to the swap file without the
+ * lock, so the next capacity misses only have to unmap their victims. The
+ * slots are registered with the io_uring of the write-back, all slots a round
+ * filled are written with one submission.
+ *
+ * The slots are the queue of the pages in flight and bound their number.
+ * Reads and writes of the swap file wait for a page in flight at their offset.
+ */
+
+#ifndef WriteBack_h
+#define WriteBack_h
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+#include "thread/Thread.h"
+#include "misc/UringSwapFile.h"
+
+#define WRITE_BACK_SLOTS 16
+#define MAX_WRITE_BACK_THREADS 8
+
+class VirtualMem;
+class WriteBack;
+
+/**
+ * Ends the process after a transfer of the swap file failed for good, the pages
+ * of the transfer are lost. Reports through the trace rings, it is called in the
+ * SIGSEGV handler as well.
+ *
+ * @param address memory of the transfer
+ * @param bytes length of the transfer
+ */
+[[noreturn]] void swapFileFailed(const void *address, size_t bytes);
+
+class WriteBackWorker : public Thread
+{
+public:
+	void start(WriteBack *writeBack);
+
+	void run();
+
+private:
+	WriteBack *writeBack = NULL;
+};
+
+enum write_back_slot : int
+{
+	SLOT_FREE,
+	SLOT_CLAIMED,   //holds a copy of the page, not written yet
+	SLOT_WRITING
+};
+
+class WriteBack
+{
+public:
+	WriteBack(VirtualMem& memory) : memory(memory) {}
+
+	/**
+	 * @param threads number of workers, 0 leaves the write-back to the evictions
+	 * @param fd descriptor of the swap file
+	 * @return false if the slots couldn't be mapped
+	 */
+	bool start(unsigned threads, size_t pageSize, int fd);
+
+	/**
+	 * Lets the workers write the slots they hold and waits for them.
+	 */
+	void stop();
+
+	bool isRunning();
+
+	/**
+	 * An eviction wrote a dirty page, the workers clean the next victims.
+	 */
+	void wake();
+
+	/**
+	 * Reserves a slot for a copy of the page at the offset, called with the VirtualMem lock.
+	 *
+	 * @return memory for one page or NULL if all slots are in flight
+	 */
+	char *claimSlot(off_t offset);
+
+	/**
+	 * Waits until no page of the range of the swap file is in flight.
+	 */
+	void waitFor(off_t offset, size_t bytes);
+
+	void waitAll();
+
+	void work();
+
+private:
+	VirtualMem& memory;
+	UringSwapFile file;
+	size_t pageSize = 0;
+	unsigned threads = 0;
+	WriteBackWorker workers[MAX_WRITE_BACK_THREADS];
+	char *buffers = NULL;
+	write_back_slot states[WRITE_BACK_SLOTS];
+	off_t offsets[WRITE_BACK_SLOTS];
+	//claimed and writing slots, read without the lock on every swap file access
+	std::atomic<unsigned> inFlight{0};
+
+	std::mutex slotMutex;
+	//the ring has a single producer
+	std::mutex fileMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable slotWritten;
+	bool pending = false;
+	bool stopping = false;
+
+	bool overlaps(off_t offset, size_t bytes);
+	void writeClaimed();
+};
+
+#endif
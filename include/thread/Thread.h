@@ -47,6 +47,19 @@ public:
 			cerr << "Thread::create(), pthread_create failed." << endl;
 	}
 
+	//the stack belongs to the caller, joining the thread doesn't release the stacks the libc cached
+	void create(void* stack, size_t stackSize)
+	{
+		pthread_attr_t attributes;
+		pthread_attr_init(&attributes);
+		pthread_attr_setstack(&attributes, stack, stackSize);
+		int res = pthread_create(&thread, &attributes, helper, this);
+		pthread_attr_destroy(&attributes);
+		running = true;
+		if(res != 0)
+			cerr << "Thread::create(), pthread_create failed." << endl;
+	}
+
 	virtual void run() = 0;
 
 	void join()
@@ -66,7 +79,7 @@ protected:
 
 private:
 	pthread_t thread;
-	bool running;
+	bool running = false;
 
 	static void* helper(void* args)
 	{
@@ -0,0 +1,469 @@
+/*
+ * mainBench.cc
+ *
+ * Multithreaded allocator benchmarks, modelled after the usual stress tests:
+ *
+ *   larson         server churn, slot arrays are handed over to new threads every round
+ *   threadtest     every thread allocates a batch of objects and frees it again
+ *   prodcons       producer threads allocate, consumer threads free (cross-thread free)
+ *   mstress        random sizes, random mix of malloc, realloc and free
+ *   cache-scratch  threads free an object of the main thread and scribble on small objects (false sharing)
+ *
+ * Every workload runs against FirstFitHeap, FixedHeap and the glibc malloc
+ * for all thread counts of the sweep, the results are written as csv or json.
+ * Each thread does the given number of operations, so the throughput of a
+ * scalable allocator grows with the number of threads. The peak RSS of a run
+ * is how far the resident set grew over what it was before the run, it is
+ * sampled from /proc/self/statm while the run goes on.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <boost/program_options.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "runtime/LibcHeap.h"
+#include "runtime/Memalloc.h"
+#include "runtime/FixedHeap.h"
+#include "system/FixedMemory.h"
+#include "misc/Random.h"
+
+//memory and block size of the FixedHeap variant
+#define FIXED_BENCH_MEMORY (64 * 1024 * 1024)
+#define FIXED_BENCH_BLOCK 64
+
+#define LARSON_ROUNDS 4
+#define THREADTEST_BATCH 100
+#define PRODCONS_RING_SIZE 1024
+#define SCRATCH_OBJECT_SIZE 8
+#define SCRATCH_WRITES 100
+#define RSS_SAMPLE_MICROS 1000
+
+extern FirstFitHeap heap;
+
+namespace po = boost::program_options;
+
+struct BenchConfig
+{
+    size_t ops;             //operations per thread
+    size_t objects;         //live objects per thread
+    size_t minSize;
+    size_t maxSize;
+};
+
+struct BenchResult
+{
+    std::string workload;
+    std::string heap;
+    unsigned threads;
+    uint64_t ops;
+    double seconds;
+    double speedup;         //throughput relative to the first thread count of the sweep
+    long peakRssDeltaKB;    //growth of the resident set during the run, at its peak
+};
+
+/**
+ * Makes a heap without an own lock usable by several threads.
+ */
+class SerializedHeap : public Heap
+{
+public:
+    SerializedHeap(Heap& heap) : heap(heap) {}
+
+    void* malloc(size_t size) { std::lock_guard<std::mutex> lock(mutex); return heap.malloc(size); }
+    void* realloc(void* ptr, size_t size) { std::lock_guard<std::mutex> lock(mutex); return heap.realloc(ptr, size); }
+    void* calloc(size_t nmemb, size_t size) { std::lock_guard<std::mutex> lock(mutex); return heap.calloc(nmemb, size); }
+    void free(void* address) { std::lock_guard<std::mutex> lock(mutex); heap.free(address); }
+    int getSize() { return heap.getSize(); }
+    void fillList(std::list<int>* list) { heap.fillList(list); }
+    size_t getFreeBytes() { std::lock_guard<std::mutex> lock(mutex); return heap.getFreeBytes(); }
+    size_t getLargestFreeBlock() { std::lock_guard<std::mutex> lock(mutex); return heap.getLargestFreeBlock(); }
+
+private:
+    Heap& heap;
+    std::mutex mutex;
+};
+
+static void runThreads(unsigned threads, const std::function<void(unsigned)>& work)
+{
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+        workers.push_back(std::thread(work, i));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+static uint64_t larson(Heap& target, unsigned threads, const BenchConfig& config)
+{
+    std::vector<std::vector<void*> > slots(threads, std::vector<void*>(config.objects, (void*) NULL));
+
+    for (unsigned round = 0; round < LARSON_ROUNDS; round++) {
+        //a new generation of threads takes over the objects of the previous one
+        runThreads(threads, [&](unsigned id) {
+            Random random(id * LARSON_ROUNDS + round);
+            std::vector<void*>& own = slots[id];
+            for (size_t i = 0; i < config.ops / LARSON_ROUNDS; i++) {
+                size_t slot = random.next() % own.size();
+                target.free(own[slot]);
+                own[slot] = target.malloc(random.size(config.minSize, config.maxSize));
+            }
+        });
+    }
+
+    for (std::vector<void*>& own : slots) {
+        for (void* ptr : own) {
+            target.free(ptr);
+        }
+    }
+    return (uint64_t) threads * (config.ops / LARSON_ROUNDS) * LARSON_ROUNDS * 2;
+}
+
+static uint64_t threadtest(Heap& target, unsigned threads, const BenchConfig& config)
+{
+    runThreads(threads, [&](unsigned id) {
+        void* batch[THREADTEST_BATCH];
+        for (size_t i = 0; i < config.ops / THREADTEST_BATCH; i++) {
+            for (unsigned j = 0; j < THREADTEST_BATCH; j++) {
+                batch[j] = target.malloc(config.minSize);
+            }
+            for (unsigned j = 0; j < THREADTEST_BATCH; j++) {
+                target.free(batch[j]);
+            }
+        }
+    });
+    return (uint64_t) threads * (config.ops / THREADTEST_BATCH) * THREADTEST_BATCH * 2;
+}
+
+//single producer, single consumer ring of objects
+struct ObjectRing
+{
+    void* slots[PRODCONS_RING_SIZE];
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+};
+
+static uint64_t prodcons(Heap& target, unsigned threads, const BenchConfig& config)
+{
+    unsigned pairs = threads / 2;
+    std::vector<ObjectRing> rings(pairs);
+
+    runThreads(threads, [&](unsigned id) {
+        ObjectRing& ring = rings[id / 2];
+        if (id % 2 == 0) {
+            Random random(id);
+            for (size_t i = 0; i < config.ops; i++) {
+                void* ptr = target.malloc(random.size(config.minSize, config.maxSize));
+                size_t head = ring.head.load(std::memory_order_relaxed);
+                while (head - ring.tail.load(std::memory_order_acquire) == PRODCONS_RING_SIZE) {
+                    std::this_thread::yield();
+                }
+                ring.slots[head % PRODCONS_RING_SIZE] = ptr;
+                ring.head.store(head + 1, std::memory_order_release);
+            }
+        } else {
+            for (size_t i = 0; i < config.ops; i++) {
+                size_t tail = ring.tail.load(std::memory_order_relaxed);
+                while (tail == ring.head.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                target.free(ring.slots[tail % PRODCONS_RING_SIZE]);
+                ring.tail.store(tail + 1, std::memory_order_release);
+            }
+        }
+    });
+    return (uint64_t) pairs * config.ops * 2;
+}
+
+static uint64_t mstress(Heap& target, unsigned threads, const BenchConfig& config)
+{
+    runThreads(threads, [&](unsigned id) {
+        Random random(id);
+        std::vector<void*> live(config.objects, (void*) NULL);
+        for (size_t i = 0; i < config.ops; i++) {
+            size_t slot = random.next() % live.size();
+            size_t size = random.size(config.minSize, config.maxSize);
+            switch (random.next() % 4) {
+            case 0:
+            case 1:
+                target.free(live[slot]);
+                live[slot] = target.malloc(size);
+                break;
+            case 2:
+                if (live[slot] != NULL) {
+                    void* ptr = target.realloc(live[slot], size);
+                    if (ptr != NULL) {
+                        live[slot] = ptr;
+                    }
+                }
+                break;
+            default:
+                target.free(live[slot]);
+                live[slot] = NULL;
+                break;
+            }
+            if (live[slot] != NULL) {
+                *((volatile char*) live[slot]) = (char) i;
+            }
+        }
+        for (void* ptr : live) {
+            target.free(ptr);
+        }
+    });
+    return (uint64_t) threads * config.ops;
+}
+
+static uint64_t cacheScratch(Heap& target, unsigned threads, const BenchConfig& config)
+{
+    //objects of the main thread, likely neighbours in one cache line
+    std::vector<void*> initial(threads);
+    for (unsigned i = 0; i < threads; i++) {
+        initial[i] = target.malloc(SCRATCH_OBJECT_SIZE);
+    }
+
+    runThreads(threads, [&](unsigned id) {
+        target.free(initial[id]);
+        for (size_t i = 0; i < config.ops; i++) {
+            volatile char* ptr = (volatile char*) target.malloc(SCRATCH_OBJECT_SIZE);
+            for (unsigned j = 0; j < SCRATCH_WRITES; j++) {
+                ptr[j % SCRATCH_OBJECT_SIZE]++;
+            }
+            target.free((void*) ptr);
+        }
+    });
+    return (uint64_t) threads * config.ops * 2;
+}
+
+struct Workload
+{
+    const char* name;
+    uint64_t (*run)(Heap& target, unsigned threads, const BenchConfig& config);
+    unsigned threadMultiple;    //thread counts that aren't a multiple of it are skipped
+};
+
+static const Workload workloads[] = {
+    {"larson", larson, 1},
+    {"threadtest", threadtest, 1},
+    {"prodcons", prodcons, 2},
+    {"mstress", mstress, 1},
+    {"cache-scratch", cacheScratch, 1}
+};
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+/**
+ * Samples the RSS of the process while a run goes on. ru_maxrss can't be used,
+ * it is the peak of the whole process and only grows from run to run.
+ */
+class RssSampler
+{
+public:
+    RssSampler() : fd(open("/proc/self/statm", O_RDONLY)), before(rssKB()), peak(before), running(true),
+        sampler([this] {
+            while (running.load(std::memory_order_relaxed)) {
+                sample();
+                std::this_thread::sleep_for(std::chrono::microseconds(RSS_SAMPLE_MICROS));
+            }
+        })
+    {
+    }
+
+    ~RssSampler()
+    {
+        if (sampler.joinable()) {
+            stop();
+        }
+        close(fd);
+    }
+
+    /**
+     * @return how far the RSS grew over the RSS at the construction, at its peak
+     */
+    long stop()
+    {
+        running.store(false, std::memory_order_relaxed);
+        sampler.join();
+        sample();
+        return peak - before;
+    }
+
+private:
+    //reads the file by hand, the sampler must not allocate on the heap it measures
+    long rssKB()
+    {
+        char text[128];
+        ssize_t length = pread(fd, text, sizeof(text) - 1, 0);
+        if (length <= 0) {
+            return 0;
+        }
+        text[length] = '\0';
+        //the second field is the resident set in pages
+        char* resident = strchr(text, ' ');
+        return resident == NULL ? 0 : strtol(resident, NULL, 10) * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    void sample()
+    {
+        peak = std::max(peak, rssKB());
+    }
+
+    int fd;
+    long before;
+    long peak;
+    std::atomic<bool> running;
+    std::thread sampler;
+};
+
+static void writeCsv(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << "workload,heap,threads,ops,seconds,opsPerSecond,speedup,peakRssDeltaKB" << std::endl;
+    for (const BenchResult& result : results) {
+        out << result.workload << "," << result.heap << "," << result.threads << "," << result.ops << ","
+            << result.seconds << "," << result.ops / result.seconds << "," << result.speedup << ","
+            << result.peakRssDeltaKB << std::endl;
+    }
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        out << "  {\"workload\": \"" << result.workload << "\", \"heap\": \"" << result.heap
+            << "\", \"threads\": " << result.threads << ", \"ops\": " << result.ops
+            << ", \"seconds\": " << result.seconds << ", \"opsPerSecond\": " << result.ops / result.seconds
+            << ", \"speedup\": " << result.speedup << ", \"peakRssDeltaKB\": " << result.peakRssDeltaKB << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Multithreaded allocator benchmarks");
+    desc.add_options()
+        ("help,h", "Print help message")
+        ("workloads,w", po::value<std::string>()->default_value("larson,threadtest,prodcons,mstress,cache-scratch"), "Comma separated workloads")
+        ("heaps", po::value<std::string>()->default_value("libc,fixed,firstfit"), "Comma separated heaps: libc, fixed, firstfit")
+        ("threads,t", po::value<std::string>()->default_value("1,2,4,8"), "Comma separated thread counts of the sweep")
+        ("ops,n", po::value<size_t>()->default_value(100000), "Operations per thread")
+        ("objects", po::value<size_t>()->default_value(1000), "Live objects per thread (larson, mstress)")
+        ("min-size", po::value<size_t>()->default_value(8), "Smallest object size")
+        ("max-size", po::value<size_t>()->default_value(1024), "Largest object size")
+        ("format,f", po::value<std::string>()->default_value("csv"), "Output format: csv or json")
+        (",o", po::value<std::string>(), "Output file, default is stdout");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cerr << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+
+    BenchConfig config;
+    config.ops = vm["ops"].as<size_t>();
+    config.objects = std::max((size_t) 1, vm["objects"].as<size_t>());
+    config.minSize = std::max((size_t) 1, vm["min-size"].as<size_t>());
+    config.maxSize = std::max(config.minSize, vm["max-size"].as<size_t>());
+    std::string format = vm["format"].as<std::string>();
+    if (format != "csv" && format != "json") {
+        std::cerr << "|###> Error: unknown format " << format << std::endl;
+        return 1;
+    }
+
+    std::vector<unsigned> threadCounts;
+    for (const std::string& count : splitList(vm["threads"].as<std::string>())) {
+        threadCounts.push_back(std::max(1, std::stoi(count)));
+    }
+
+    LibcHeap libcHeap;
+    FixedMemory<FIXED_BENCH_MEMORY> fixedMemory;
+    FixedHeap<FIXED_BENCH_BLOCK> fixedHeap(fixedMemory);
+    SerializedHeap serializedFixedHeap(fixedHeap);
+    bool fixedInitialized = false;
+
+    std::vector<BenchResult> results;
+    for (const std::string& workloadName : splitList(vm["workloads"].as<std::string>())) {
+        const Workload* workload = NULL;
+        for (const Workload& candidate : workloads) {
+            if (workloadName == candidate.name) {
+                workload = &candidate;
+            }
+        }
+        if (workload == NULL) {
+            std::cerr << "|###> Error: unknown workload " << workloadName << std::endl;
+            return 1;
+        }
+
+        for (const std::string& heapName : splitList(vm["heaps"].as<std::string>())) {
+            Heap* target;
+            if (heapName == "libc") {
+                target = &libcHeap;
+            } else if (heapName == "firstfit") {
+                target = &heap;
+            } else if (heapName == "fixed") {
+                if (!fixedInitialized) {
+                    fixedMemory.initMem();
+                    fixedHeap.initHeap();
+                    fixedInitialized = true;
+                }
+                target = &serializedFixedHeap;
+            } else {
+                std::cerr << "|###> Error: unknown heap " << heapName << std::endl;
+                return 1;
+            }
+
+            double firstThroughput = 0;
+            for (unsigned threads : threadCounts) {
+                if (threads % workload->threadMultiple != 0) {
+                    std::cerr << workloadName << " skips " << threads << " threads, it runs a multiple of "
+                              << workload->threadMultiple << std::endl;
+                    continue;
+                }
+                std::cerr << workloadName << " on " << heapName << " with " << threads << " threads" << std::endl;
+                RssSampler rss;
+                auto start = std::chrono::steady_clock::now();
+                uint64_t ops = workload->run(*target, threads, config);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                long peakRssDelta = rss.stop();
+
+                double throughput = ops / seconds;
+                if (firstThroughput == 0) {
+                    firstThroughput = throughput;
+                }
+                BenchResult result = {workloadName, heapName, threads, ops, seconds, throughput / firstThroughput, peakRssDelta};
+                results.push_back(result);
+            }
+        }
+    }
+
+    if (vm.count("-o")) {
+        std::ofstream file(vm["-o"].as<std::string>(), std::ofstream::trunc);
+        format == "json" ? writeJson(file, results) : writeCsv(file, results);
+    } else {
+        format == "json" ? writeJson(std::cout, results) : writeCsv(std::cout, results);
+    }
+    return 0;
+}
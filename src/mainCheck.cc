@@ -0,0 +1,688 @@
+/*
+ * mainCheck.cc
+ *
+ * Self-checks of the components, built and run with make check. Every failed
+ * check is reported and the run goes on, the exit code is 1 if one of them
+ * failed. The checks of the paging run in a child process with memory of its
+ * own, the heap of the check lives in the paged memory:
+ *
+ *   recorder   addresses that collide in the id table keep their ids when
+ *              others are deleted, realloc hands the ids over
+ *   codec      pages of all kinds decompress to what was compressed, corrupt
+ *              data is rejected, the compressed tier keeps the pages it took
+ *   swap slots slot 0 is never handed out, slots are handed out in order and
+ *              again after a release, the allocator is exhausted at its size,
+ *              emptied clusters are reported for punching and reused first
+ *   swap file  short transfers are continued, failed ones repeated until the
+ *              attempts are used up
+ *   page list  FIFO order, removing and moving pages keeps the order of the
+ *              others, marks and list membership are independent
+ *   policies   2Q and ARC keep the pages that were used again through a scan,
+ *              ARC moves its target by the ghost hits and clamps it to the capacity
+ *   frames     a shrunk frame budget keeps all of its free frames, the
+ *              smallest budget pages through more leaf tables than it has frames
+ *   discard    the maintenance worker gives the frames of freed blocks back,
+ *              evicted pages of freed blocks lose their fill word and are new
+ *              pages again, the blocks that stay keep their content
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "misc/AllocationTrace.h"
+#include "system/VirtualMem.h"
+#include "runtime/FirstFitHeap.h"
+#include "system/ReplacementPolicy.h"
+#include "system/CompressedSwap.h"
+#include "system/SwapSlots.h"
+#include "misc/PageCompressor.h"
+#include "misc/RandomAccessFile.h"
+
+//addresses of the recorder check that fall into the first and the last slots of its table
+#define RECORDER_COLLISIONS 64
+#define RECORDER_COLLISION_SLOTS 4
+
+//the lists only number the pages, the area of the policy and list checks is never touched
+#define CHECK_AREA ((char*) 0x100000000000ul)
+#define CHECK_PAGE_SIZE 4096
+#define CHECK_PAGES 1024
+#define CHECK_PAGE(i) ((void*) (CHECK_AREA + (size_t) (i) * CHECK_PAGE_SIZE))
+
+//frames of the child that shrinks its budget and the pages it touches then
+#define SHRINK_FRAMES_FROM 64
+#define SHRINK_FRAMES_TO 20
+#define SHRINK_PAGES 60
+//pages of the child with the smallest budget, each one is mapped by a leaf table of its own
+#define SPREAD_PAGES 40
+#define SPREAD_STRIDE (3ul << 21)
+//frames of the child that frees heap blocks, the blocks fit into them
+#define DISCARD_FRAMES 256
+#define DISCARD_BLOCKS 6
+#define DISCARD_BLOCK_SIZE (96 * 1024)
+//environment variables passed on to a child
+#define CHILD_VARIABLES 256
+
+extern VirtualMem vMem;
+extern FirstFitHeap heap;
+extern char** environ;
+
+static unsigned checks = 0;
+static unsigned failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+static void check(bool passed, const char* condition, const char* file, int line)
+{
+    checks++;
+    if (!passed) {
+        failures++;
+        std::cerr << "|###> Error: check failed: " << condition << " (" << file << ":" << line << ")" << std::endl;
+    }
+}
+
+/////////////////////////////////////////////////
+// AllocationRecorder
+
+//the hash of the recorder, the check looks for addresses that collide
+static size_t recorderSlot(uint64_t address)
+{
+    return (size_t) (((address >> 4) * 0x9E3779B97F4A7C15ull) >> (64 - RECORDER_TABLE_BITS));
+}
+
+//the records of a trace in the order of the file, one thread writes them
+static std::vector<AllocRecord> readTrace(const char* path)
+{
+    std::vector<AllocRecord> records;
+    std::ifstream file(path, std::ios::binary);
+    AllocTraceHeader header;
+    if (!file.read((char*) &header, sizeof(header)) || header.magic != ALLOC_TRACE_MAGIC) {
+        return records;
+    }
+    AllocTraceChunk chunk;
+    while (file.read((char*) &chunk, sizeof(chunk))) {
+        size_t first = records.size();
+        records.resize(first + chunk.count);
+        file.read((char*) &records[first], chunk.count * sizeof(AllocRecord));
+    }
+    return records;
+}
+
+static void checkRecorder()
+{
+    //probe sequences that are long and wrap around the end of the table
+    std::vector<const void*> addresses;
+    size_t tableSize = (size_t) 1 << RECORDER_TABLE_BITS;
+    for (uint64_t address = 16; addresses.size() < RECORDER_COLLISIONS; address += 16) {
+        size_t slot = recorderSlot(address);
+        if (slot < RECORDER_COLLISION_SLOTS || slot >= tableSize - RECORDER_COLLISION_SLOTS) {
+            addresses.push_back((const void*) address);
+        }
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/memalloc-check-%d.trace", (int) getpid());
+    setenv("MEMALLOC_TRACE", path, 1);
+    std::vector<uint32_t> expected;
+    uint32_t reallocOldId = 0;
+    {
+        AllocationRecorder recorder;
+        unsetenv("MEMALLOC_TRACE");
+
+        //ids are handed out in order, a free must find the id of its address
+        std::vector<uint32_t> ids(RECORDER_COLLISIONS);
+        uint32_t nextId = 1;
+        for (size_t i = 0; i < addresses.size(); i++) {
+            recorder.record(ALLOC_MALLOC, addresses[i], NULL, 16);
+            ids[i] = nextId++;
+            expected.push_back(ids[i]);
+        }
+        //every third one first, the others have to be shifted back into the gaps
+        for (size_t start = 0; start < 3; start++) {
+            for (size_t i = start; i < addresses.size(); i += 3) {
+                recorder.record(ALLOC_FREE, NULL, addresses[i], 0);
+                expected.push_back(ids[i]);
+                if (start == 0) {
+                    recorder.record(ALLOC_MALLOC, addresses[i], NULL, 16);
+                    ids[i] = nextId++;
+                    expected.push_back(ids[i]);
+                }
+            }
+        }
+
+        //a moved block: its address is taken by the next malloc before the realloc is recorded
+        const void* old = addresses[0];
+        const void* moved = addresses[1];
+        uint32_t oldId = recorder.detachRealloc(old);
+        CHECK(oldId == ids[0]);
+        reallocOldId = oldId;
+        recorder.record(ALLOC_MALLOC, old, NULL, 16);
+        uint32_t reusedId = nextId++;
+        expected.push_back(reusedId);
+        recorder.recordRealloc(moved, old, oldId, 32);
+        uint32_t movedId = nextId++;
+        expected.push_back(movedId);
+
+        //a realloc that failed gives the block its id back
+        uint32_t failedId = recorder.detachRealloc(moved);
+        recorder.recordRealloc(NULL, moved, failedId, 1 << 30);
+        recorder.record(ALLOC_FREE, NULL, moved, 0);
+        expected.push_back(movedId);
+        recorder.record(ALLOC_FREE, NULL, old, 0);
+        expected.push_back(reusedId);
+    }
+
+    std::vector<AllocRecord> records = readTrace(path);
+    unlink(path);
+    CHECK(records.size() == expected.size());
+    for (size_t i = 0; i < records.size() && i < expected.size(); i++) {
+        CHECK(records[i].id == expected[i]);
+        if (records[i].op == ALLOC_REALLOC) {
+            CHECK(records[i].oldId == reallocOldId);
+        }
+    }
+}
+
+/////////////////////////////////////////////////
+// PageCompressor
+
+enum page_kind
+{
+    PAGE_ZERO,
+    PAGE_WORDS,         //a few distinct words, long matches
+    PAGE_PERIOD_3,      //matches that overlap the bytes they produce
+    PAGE_TEXT,          //short matches between literals
+    PAGE_RANDOM,        //no matches, longer than 15 + 255 literals
+    NUMBER_OF_PAGE_KINDS
+};
+
+static void fillCheckPage(char* page, page_kind kind, unsigned seed)
+{
+    unsigned random = seed * 2654435761u + 1;
+    for (size_t i = 0; i < CHECK_PAGE_SIZE; i++) {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        switch (kind) {
+        case PAGE_ZERO:
+            page[i] = 0;
+            break;
+        case PAGE_WORDS:
+            page[i] = (char) ((i / 512) * 17 + i % 8);
+            break;
+        case PAGE_PERIOD_3:
+            page[i] = "abc"[i % 3];
+            break;
+        case PAGE_TEXT:
+            page[i] = random % 16 == 0 ? (char) ('a' + random % 26) : "the page "[i % 9];
+            break;
+        default:
+            page[i] = (char) random;
+            break;
+        }
+    }
+}
+
+static void checkCompressor()
+{
+    static PageCompressor compressor;
+    static char page[CHECK_PAGE_SIZE];
+    static char compressed[2 * CHECK_PAGE_SIZE];
+    static char restored[CHECK_PAGE_SIZE];
+
+    for (int kind = 0; kind < NUMBER_OF_PAGE_KINDS; kind++) {
+        fillCheckPage(page, (page_kind) kind, kind + 1);
+        size_t length = compressor.compress(page, CHECK_PAGE_SIZE, compressed, sizeof(compressed));
+        CHECK(length != 0);
+        CHECK(kind == PAGE_RANDOM || length < CHECK_PAGE_SIZE / 2);
+        memset(restored, 0x55, sizeof(restored));
+        CHECK(compressor.decompress(compressed, length, restored, CHECK_PAGE_SIZE));
+        CHECK(memcmp(page, restored, CHECK_PAGE_SIZE) == 0);
+
+        //a cut stream, a wrong size and a match before the start of the page
+        CHECK(!compressor.decompress(compressed, length / 2, restored, CHECK_PAGE_SIZE));
+        CHECK(!compressor.decompress(compressed, length, restored, CHECK_PAGE_SIZE - 1));
+    }
+    fillCheckPage(page, PAGE_ZERO, 0);
+    size_t length = compressor.compress(page, CHECK_PAGE_SIZE, compressed, sizeof(compressed));
+    compressed[2] = (char) 0xFF;
+    compressed[3] = (char) 0xFF;
+    CHECK(!compressor.decompress(compressed, length, restored, CHECK_PAGE_SIZE));
+
+    //the capacity is a hard limit
+    fillCheckPage(page, PAGE_RANDOM, 7);
+    CHECK(compressor.compress(page, CHECK_PAGE_SIZE, compressed, CHECK_PAGE_SIZE / 2) == 0);
+}
+
+static void checkCompressedSwap()
+{
+    static char page[CHECK_PAGE_SIZE];
+    static char restored[CHECK_PAGE_SIZE];
+    CompressedSwap tier;
+    CHECK(tier.create(4 * CHECK_PAGE_SIZE, CHECK_PAGE_SIZE, 16));
+    if (!tier.isEnabled()) {
+        return;
+    }
+    for (unsigned i = 0; i < 8; i++) {
+        fillCheckPage(page, PAGE_TEXT, i);
+        CHECK(tier.store(i, page));
+    }
+    for (unsigned i = 0; i < 8; i++) {
+        fillCheckPage(page, PAGE_TEXT, i);
+        CHECK(tier.load(i, restored) && memcmp(page, restored, CHECK_PAGE_SIZE) == 0);
+    }
+    //a page that doesn't shrink goes to the swap file, a page that got dirty is gone
+    fillCheckPage(page, PAGE_RANDOM, 1);
+    CHECK(!tier.store(8, page) && !tier.contains(8));
+    tier.drop(3);
+    CHECK(!tier.contains(3) && !tier.load(3, restored));
+    //a new content replaces the old one
+    fillCheckPage(page, PAGE_WORDS, 0);
+    CHECK(tier.store(4, page));
+    CHECK(tier.load(4, restored) && memcmp(page, restored, CHECK_PAGE_SIZE) == 0);
+    tier.reset();
+    CHECK(!tier.contains(0));
+    tier.destroy();
+}
+
+/////////////////////////////////////////////////
+// SwapSlots
+
+static void checkSwapSlots()
+{
+    SwapSlots slots;
+    bool emptyCluster;
+    //two clusters and one slot of a third, slot 0 included
+    CHECK(slots.create(2 * SWAP_CLUSTER_SLOTS + 1));
+
+    //evicted one after the other, written in order
+    bool inOrder = true;
+    for (unsigned slot = 1; slot <= 2 * SWAP_CLUSTER_SLOTS; slot++) {
+        inOrder = inOrder && slots.allocate(&emptyCluster) == slot;
+    }
+    CHECK(inOrder);
+    CHECK(slots.allocate(&emptyCluster) == SWAP_NO_SLOT);
+
+    CHECK(!slots.release(SWAP_NO_SLOT));
+    slots.release(5);
+    CHECK(slots.allocate(&emptyCluster) == 5);
+    CHECK(slots.allocate(&emptyCluster) == SWAP_NO_SLOT);
+
+    //the cluster of slot 0 is never empty, the second one is when it is first used
+    slots.reset();
+    CHECK(slots.allocate(&emptyCluster) == 1 && !emptyCluster);
+    for (unsigned slot = 2; slot < SWAP_CLUSTER_SLOTS; slot++) {
+        slots.allocate(&emptyCluster);
+    }
+    CHECK(slots.allocate(&emptyCluster) == SWAP_CLUSTER_SLOTS && emptyCluster);
+    CHECK(slots.allocate(&emptyCluster) == SWAP_CLUSTER_SLOTS + 1 && !emptyCluster);
+    for (unsigned slot = SWAP_CLUSTER_SLOTS + 2; slot < 2 * SWAP_CLUSTER_SLOTS; slot++) {
+        slots.allocate(&emptyCluster);
+    }
+
+    //only the release of the last used slot of a cluster lets it be punched
+    bool punched = false;
+    for (unsigned slot = SWAP_CLUSTER_SLOTS; slot < 2 * SWAP_CLUSTER_SLOTS - 1; slot++) {
+        punched = punched || slots.release(slot);
+    }
+    CHECK(!punched);
+    CHECK(slots.release(2 * SWAP_CLUSTER_SLOTS - 1));
+    CHECK(!slots.release(1));
+
+    //the punched cluster is taken again before the gap in the first one
+    CHECK(slots.allocate(&emptyCluster) == SWAP_CLUSTER_SLOTS && emptyCluster);
+    slots.destroy();
+}
+
+/////////////////////////////////////////////////
+// RandomAccessFile
+
+//a file in memory that fails a number of transfers and copies at most a number of bytes per transfer
+class FlakyFile : public RandomAccessFile {
+public:
+    char content[2 * CHECK_PAGE_SIZE];
+    unsigned failing = 0;
+    size_t chunk = CHECK_PAGE_SIZE;
+    unsigned transfers = 0;
+
+    ssize_t swapFileRead(void* addr, off_t offset, size_t bytes) {
+        return transfer((char*) addr, content + offset, bytes);
+    }
+    ssize_t swapFileWrite(void* addr, off_t offset, size_t bytes) {
+        return transfer(content + offset, (char*) addr, bytes);
+    }
+    ssize_t swapFilereserve(off_t, size_t bytes) { return bytes; }
+    ssize_t swapFilerelease(off_t, size_t bytes) { return bytes; }
+
+private:
+    ssize_t transfer(char* to, const char* from, size_t bytes) {
+        transfers++;
+        if (failing > 0) {
+            failing--;
+            return -1;
+        }
+        size_t copied = bytes < chunk ? bytes : chunk;
+        memcpy(to, from, copied);
+        return copied;
+    }
+};
+
+static void checkSwapFile()
+{
+    FlakyFile file;
+    static char page[CHECK_PAGE_SIZE];
+    static char restored[CHECK_PAGE_SIZE];
+    for (unsigned i = 0; i < CHECK_PAGE_SIZE; i++) {
+        page[i] = (char) (i * 7);
+    }
+
+    //a page written in pieces between failures arrives whole
+    file.chunk = CHECK_PAGE_SIZE / 3;
+    file.failing = SWAP_IO_ATTEMPTS - 1;
+    CHECK(file.writeFully(page, CHECK_PAGE_SIZE, CHECK_PAGE_SIZE));
+    CHECK(file.transfers == SWAP_IO_ATTEMPTS - 1 + 4);
+    CHECK(file.readFully(restored, CHECK_PAGE_SIZE, CHECK_PAGE_SIZE));
+    CHECK(memcmp(page, restored, CHECK_PAGE_SIZE) == 0);
+
+    //the attempts are used up, the transfer is given up
+    file.transfers = 0;
+    file.failing = SWAP_IO_ATTEMPTS;
+    CHECK(!file.readFully(restored, 0, CHECK_PAGE_SIZE));
+    CHECK(file.transfers == SWAP_IO_ATTEMPTS);
+}
+
+/////////////////////////////////////////////////
+// PageList
+
+//the pages of the list from the front, the list stays as it was
+static std::vector<void*> listPages(PageList& list)
+{
+    std::vector<void*> pages;
+    for (size_t i = list.size(); i > 0; i--) {
+        void* page = list.dequeue();
+        pages.push_back(page);
+        list.enqueue(page);
+    }
+    return pages;
+}
+
+static void checkPageList()
+{
+    PageLinks links;
+    CHECK(links.create(CHECK_AREA, CHECK_PAGE_SIZE, CHECK_PAGES));
+    PageList first(links, 1);
+    PageList second(links, 2);
+
+    CHECK(first.checkEmpty() && first.peek() == NULL && first.dequeue() == NULL);
+    for (unsigned i = 0; i < 5; i++) {
+        first.enqueue(CHECK_PAGE(i));
+    }
+    second.enqueue(CHECK_PAGE(CHECK_PAGES - 1));
+    CHECK(first.size() == 5 && second.size() == 1);
+    CHECK(first.peek() == CHECK_PAGE(0));
+    CHECK(first.contains(CHECK_PAGE(3)) && !second.contains(CHECK_PAGE(3)));
+    CHECK(second.contains(CHECK_PAGE(CHECK_PAGES - 1)));
+
+    //the middle, the front and the rear
+    CHECK(first.remove(CHECK_PAGE(2)));
+    CHECK(!first.remove(CHECK_PAGE(2)));
+    CHECK(!second.remove(CHECK_PAGE(1)));
+    first.moveToRear(CHECK_PAGE(0));
+    first.moveToRear(CHECK_PAGE(0));
+    std::vector<void*> order = {CHECK_PAGE(1), CHECK_PAGE(3), CHECK_PAGE(4), CHECK_PAGE(0)};
+    CHECK(listPages(first) == order);
+
+    //a page changes lists, its mark stays
+    links.setMarked(CHECK_PAGE(4), true);
+    CHECK(first.remove(CHECK_PAGE(4)));
+    second.enqueue(CHECK_PAGE(4));
+    CHECK(links.isMarked(CHECK_PAGE(4)) && !links.isMarked(CHECK_PAGE(3)));
+    CHECK(second.contains(CHECK_PAGE(4)) && !first.contains(CHECK_PAGE(4)));
+    links.setMarked(CHECK_PAGE(4), false);
+    CHECK(!links.isMarked(CHECK_PAGE(4)) && second.contains(CHECK_PAGE(4)));
+
+    CHECK(first.dequeue() == CHECK_PAGE(1));
+    first.clear();
+    CHECK(first.checkEmpty() && !first.contains(CHECK_PAGE(3)));
+    CHECK(second.size() == 2 && second.peek() == CHECK_PAGE(CHECK_PAGES - 1));
+    first.enqueue(CHECK_PAGE(3));
+    CHECK(first.peek() == CHECK_PAGE(3) && first.size() == 1);
+    links.destroy();
+}
+
+/////////////////////////////////////////////////
+// ReplacementPolicy
+
+//like the VirtualMem: the victim leaves before the new page comes in
+static void *replacePage(ReplacementPolicy* policy, void* page)
+{
+    void* victim = policy->chooseVictim(page);
+    policy->onEvict(victim);
+    policy->onFault(page);
+    return victim;
+}
+
+static void checkTwoQueue()
+{
+    //Kin = 2, Kout = 4
+    ReplacementPolicy* policy = ReplacementPolicy::create(REPLACE_2Q, 8, CHECK_AREA, CHECK_PAGE_SIZE, CHECK_PAGES);
+    CHECK(policy != NULL);
+    if (policy == NULL) {
+        return;
+    }
+    for (unsigned i = 0; i < 8; i++) {
+        policy->onFault(CHECK_PAGE(i));
+    }
+    //page 0 leaves A1in for A1out and comes back into Am
+    CHECK(replacePage(policy, CHECK_PAGE(0)) == CHECK_PAGE(0));
+    CHECK(policy->getResidentCount() == 8);
+
+    //a scan only replaces the pages of A1in
+    bool kept = true;
+    for (unsigned i = 100; i < 120; i++) {
+        kept = kept && replacePage(policy, CHECK_PAGE(i)) != CHECK_PAGE(0);
+    }
+    CHECK(kept);
+    CHECK(policy->getResidentCount() == 8);
+    ReplacementPolicy::destroy(policy);
+}
+
+static void checkArc()
+{
+    ReplacementPolicy* policy = ReplacementPolicy::create(REPLACE_ARC, 8, CHECK_AREA, CHECK_PAGE_SIZE, CHECK_PAGES);
+    CHECK(policy != NULL);
+    if (policy == NULL) {
+        return;
+    }
+    //T1 = 2..7, T2 = 0, 1
+    for (unsigned i = 0; i < 8; i++) {
+        policy->onFault(CHECK_PAGE(i));
+    }
+    policy->onAccess(CHECK_PAGE(0));
+    policy->onAccess(CHECK_PAGE(1));
+
+    //every hit in B1 moves the target of T1 up by one: 2..4 end in T2, the target is 3
+    for (unsigned i = 2; i < 5; i++) {
+        void* victim = policy->chooseVictim(NULL);
+        CHECK(victim == CHECK_PAGE(i));
+        policy->onEvict(victim);
+        policy->onFault(CHECK_PAGE(i));
+    }
+    CHECK(policy->getResidentCount() == 8);
+
+    //T1 = 5..7 is not above the target, T2 gives the victim
+    CHECK(policy->chooseVictim(NULL) == CHECK_PAGE(0));
+
+    //the page tables took frames: the target shrinks with the capacity, T1 is above it now
+    policy->setCapacity(2);
+    CHECK(policy->chooseVictim(NULL) == CHECK_PAGE(5));
+
+    //a scan doesn't reach T2
+    bool kept = true;
+    for (unsigned i = 200; i < 220; i++) {
+        void* victim = replacePage(policy, CHECK_PAGE(i));
+        kept = kept && (size_t) ((char*) victim - CHECK_AREA) >= 5 * CHECK_PAGE_SIZE;
+    }
+    CHECK(kept);
+    ReplacementPolicy::destroy(policy);
+}
+
+/////////////////////////////////////////////////
+// VirtualMem, in child processes
+
+/**
+ * Runs the check again as a child process that does one paging check.
+ *
+ * @param check the option of the child
+ * @param frames MEMALLOC_FRAMES of the child
+ * @return the exit code of the child, -1 if it didn't exit
+ */
+static int runChild(const char* check, unsigned frames)
+{
+    //the kernel reads the arguments, it can't fault in pages of the heap, so they are on the stack
+    char framesVariable[32];
+    snprintf(framesVariable, sizeof(framesVariable), "MEMALLOC_FRAMES=%u", frames);
+    char* envp[CHILD_VARIABLES + 2];
+    size_t variables = 0;
+    for (char** variable = environ; *variable != NULL && variables < CHILD_VARIABLES; variable++) {
+        if (strncmp(*variable, "MEMALLOC_FRAMES=", 16) != 0) {
+            envp[variables++] = *variable;
+        }
+    }
+    envp[variables++] = framesVariable;
+    envp[variables] = NULL;
+    char* argv[] = {(char*) "selfcheck", (char*) check, NULL};
+
+    pid_t pid;
+    int status;
+    if (posix_spawn(&pid, "/proc/self/exe", NULL, NULL, argv, envp) != 0 || waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+//the reset discards the heap, so the child doesn't allocate and leaves with _exit
+static void shrinkFrameBudget()
+{
+    vMem.initializeVirtualMem(false);
+    if (!vMem.setFrameBudget(SHRINK_FRAMES_TO)) {
+        _exit(2);
+    }
+    //more pages than frames, every frame is used and evicted
+    char* memory = (char*) vMem.getStart();
+    for (unsigned i = 0; i < SHRINK_PAGES; i++) {
+        memory[i * vMem.getPageSize()] = (char) i;
+    }
+    for (unsigned i = 0; i < SHRINK_PAGES; i++) {
+        if (memory[i * vMem.getPageSize()] != (char) i) {
+            _exit(3);
+        }
+    }
+    _exit(0);
+}
+
+//the leaf tables of pages that were evicted have to make room for the next ones
+static void spreadTables()
+{
+    vMem.initializeVirtualMem(false);
+    if (vMem.setFrameBudget(MIN_FRAMES - 1)) {
+        _exit(2);
+    }
+    char* memory = (char*) vMem.getStart();
+    for (unsigned round = 0; round < 2; round++) {
+        for (unsigned i = 0; i < SPREAD_PAGES; i++) {
+            memory[i * SPREAD_STRIDE] += (char) i;
+        }
+    }
+    for (unsigned i = 0; i < SPREAD_PAGES; i++) {
+        if (memory[i * SPREAD_STRIDE] != (char) (2 * i)) {
+            _exit(3);
+        }
+    }
+    _exit(0);
+}
+
+//all blocks but the last two are freed, their pages leave the frames. The last
+//two are evicted, they are same filled, then the first of them is freed as well
+static void discardFreed()
+{
+    char* blocks[DISCARD_BLOCKS];
+    heap.startMaintenance(100);
+    for (unsigned i = 0; i < DISCARD_BLOCKS; i++) {
+        blocks[i] = (char*) heap.malloc(DISCARD_BLOCK_SIZE);
+        memset(blocks[i], i + 1, DISCARD_BLOCK_SIZE);
+    }
+    unsigned resident = vMem.pagesinRAM;
+    for (unsigned i = 0; i + 2 < DISCARD_BLOCKS; i++) {
+        heap.free(blocks[i]);
+    }
+    heap.stopMaintenance();
+    size_t freedPages = (DISCARD_BLOCKS - 2) * (DISCARD_BLOCK_SIZE / vMem.getPageSize() - 1);
+    if (vMem.pagesinRAM + freedPages > resident) {
+        _exit(2);
+    }
+
+    vMem.resetQueues();
+    heap.startMaintenance(100);
+    heap.free(blocks[DISCARD_BLOCKS - 2]);
+    heap.stopMaintenance();
+    //the freed memory is only read, a page with its old fill word would be faulted in with it
+    size_t pageSize = vMem.getPageSize();
+    char* page = (char*) (((uintptr_t) blocks[DISCARD_BLOCKS - 2] + pageSize - 1) / pageSize * pageSize);
+    for (unsigned i = 0; i < pageSize; i++) {
+        if (page[i] != 0) {
+            _exit(4);
+        }
+    }
+
+    char* kept = blocks[DISCARD_BLOCKS - 1];
+    for (unsigned i = 0; i < DISCARD_BLOCK_SIZE; i++) {
+        if (kept[i] != (char) DISCARD_BLOCKS) {
+            _exit(3);
+        }
+    }
+    _exit(0);
+}
+
+static void checkFrames()
+{
+    CHECK(runChild("--shrink-frames", SHRINK_FRAMES_FROM) == 0);
+    CHECK(runChild("--spread-tables", MIN_FRAMES) == 0);
+}
+
+static void checkDiscard()
+{
+    CHECK(runChild("--discard-freed", DISCARD_FRAMES) == 0);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && strcmp(argv[1], "--shrink-frames") == 0) {
+        shrinkFrameBudget();
+    }
+    if (argc == 2 && strcmp(argv[1], "--spread-tables") == 0) {
+        spreadTables();
+    }
+    if (argc == 2 && strcmp(argv[1], "--discard-freed") == 0) {
+        discardFreed();
+    }
+
+    checkRecorder();
+    checkCompressor();
+    checkCompressedSwap();
+    checkSwapSlots();
+    checkSwapFile();
+    checkPageList();
+    checkTwoQueue();
+    checkArc();
+    checkFrames();
+    checkDiscard();
+
+    std::cout << checks << " checks, " << failures << " failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -51,7 +51,7 @@ int main(int argc, char** argv)
 				cin.ignore(INT_MAX, '\n');
 
 			} else {
-				ptr = heap.alloc(input2);
+				ptr = heap.malloc(input2);
 				cout << "ptr1 is " << ptr <<endl;
 				
 				gui.clearWindow();
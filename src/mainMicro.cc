@@ -0,0 +1,319 @@
+/*
+ * mainMicro.cc
+ *
+ * Latency of single allocator calls, measured with the CycleTimer.
+ * For every heap, size class and operation (malloc, free, realloc, calloc)
+ * the tool reports the p50, p99, p999 and max in ticks:
+ *
+ *   hot   the calls follow each other, the meta data of the heap is in the cache
+ *   cold  a buffer larger than the caches is written before every call
+ *
+ * Before the measurements every heap is fragmented with a number of random
+ * malloc/free calls whose objects stay alive, so the fast paths are measured
+ * on a used heap and not on a fresh one.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <sys/mman.h>
+#include "timer/CycleTimer.h"
+#include "runtime/LibcHeap.h"
+#include "runtime/Memalloc.h"
+#include "runtime/FixedHeap.h"
+#include "system/FixedMemory.h"
+#include "misc/Random.h"
+
+//memory and block size of the FixedHeap variant
+#define FIXED_MICRO_MEMORY (64 * 1024 * 1024)
+#define FIXED_MICRO_BLOCK 64
+
+//live objects of the fragmentation warm-up
+#define WARMUP_OBJECTS 1000
+#define WARMUP_MIN_SIZE 8
+#define WARMUP_MAX_SIZE 4096
+
+#define CACHE_LINE 64
+
+extern FirstFitHeap heap;
+
+namespace po = boost::program_options;
+
+enum micro_op
+{
+    MICRO_MALLOC,
+    MICRO_FREE,
+    MICRO_REALLOC,
+    MICRO_CALLOC,
+    NUMBER_OF_MICRO_OPS
+};
+
+static const char* opNames[NUMBER_OF_MICRO_OPS] = {"malloc", "free", "realloc", "calloc"};
+
+struct MicroConfig
+{
+    size_t samples;         //measured calls per size class in hot mode
+    size_t coldSamples;     //measured calls per size class in cold mode
+    size_t coldBufferSize;  //bytes written between two cold calls
+    size_t warmup;          //random calls before the measurements
+};
+
+//memory outside of the heaps, the measurements must not change them
+static void* mapArray(size_t bytes)
+{
+    void* array = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (array == MAP_FAILED) {
+        std::cerr << "|###> Error: can't map " << bytes << " bytes" << std::endl;
+        exit(1);
+    }
+    return array;
+}
+
+class LatencyRecorder
+{
+public:
+    LatencyRecorder(size_t capacity) : count(0), failed(0)
+    {
+        samples = (ticks*) mapArray(capacity * sizeof(ticks));
+    }
+
+    void add(ticks latency)
+    {
+        samples[count++] = latency;
+    }
+
+    //p-th per mille after sort()
+    ticks perMille(unsigned p)
+    {
+        if (count == 0) {
+            return 0;
+        }
+        size_t index = (count * p) / 1000;
+        return samples[std::min(index, count - 1)];
+    }
+
+    void sort()
+    {
+        std::sort(samples, samples + count);
+    }
+
+    void clear()
+    {
+        count = 0;
+        failed = 0;
+    }
+
+    size_t count;
+    size_t failed;          //calls that returned NULL, their latency is included
+
+private:
+    ticks* samples;
+};
+
+/**
+ * Evicts the caches by writing one byte per cache line of a large buffer.
+ */
+class CacheEvictor
+{
+public:
+    CacheEvictor(size_t size) : size(size)
+    {
+        buffer = (volatile char*) mapArray(size);
+    }
+
+    void evict()
+    {
+        for (size_t i = 0; i < size; i += CACHE_LINE) {
+            buffer[i]++;
+        }
+    }
+
+private:
+    volatile char* buffer;
+    size_t size;
+};
+
+/**
+ * Random malloc/free calls, the objects that are alive at the end stay in the heap.
+ */
+static void fragment(Heap& target, void** live, size_t calls)
+{
+    Random random(42);
+    for (size_t i = 0; i < calls; i++) {
+        size_t slot = random.next() % WARMUP_OBJECTS;
+        target.free(live[slot]);
+        live[slot] = (random.next() % 4 == 0) ? NULL : target.malloc(random.size(WARMUP_MIN_SIZE, WARMUP_MAX_SIZE));
+    }
+}
+
+/**
+ * Measures all operations for one size class.
+ * malloc and free are measured on the same objects, realloc doubles the size.
+ */
+static void measure(Heap& target, size_t size, size_t samples, CacheEvictor* evictor,
+    void** objects, LatencyRecorder* recorders)
+{
+    CycleTimer timer;
+
+    for (size_t i = 0; i < samples; i++) {
+        if (evictor) evictor->evict();
+        timer.start();
+        objects[i] = target.malloc(size);
+        recorders[MICRO_MALLOC].add(timer.stop());
+        recorders[MICRO_MALLOC].failed += objects[i] == NULL;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        if (evictor) evictor->evict();
+        timer.start();
+        target.free(objects[samples - 1 - i]);
+        recorders[MICRO_FREE].add(timer.stop());
+    }
+
+    for (size_t i = 0; i < samples; i++) {
+        objects[i] = target.malloc(size);
+    }
+    for (size_t i = 0; i < samples; i++) {
+        if (evictor) evictor->evict();
+        timer.start();
+        void* ptr = target.realloc(objects[i], 2 * size);
+        recorders[MICRO_REALLOC].add(timer.stop());
+        if (ptr != NULL) {
+            objects[i] = ptr;
+        } else {
+            recorders[MICRO_REALLOC].failed++;
+        }
+    }
+    for (size_t i = 0; i < samples; i++) {
+        target.free(objects[i]);
+    }
+
+    for (size_t i = 0; i < samples; i++) {
+        if (evictor) evictor->evict();
+        timer.start();
+        objects[i] = target.calloc(1, size);
+        recorders[MICRO_CALLOC].add(timer.stop());
+        recorders[MICRO_CALLOC].failed += objects[i] == NULL;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        target.free(objects[i]);
+    }
+}
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Latency of single allocator calls, p50/p99/p999 in CPU ticks");
+    desc.add_options()
+        ("help,h", "Print help message")
+        ("heaps", po::value<std::string>()->default_value("libc,fixed,firstfit"), "Comma separated heaps: libc, fixed, firstfit")
+        ("sizes", po::value<std::string>()->default_value("8,16,32,64,256,1024,4096,16384,131072"), "Comma separated size classes")
+        ("samples,n", po::value<size_t>()->default_value(10000), "Measured calls per size class, hot")
+        ("cold-samples", po::value<size_t>()->default_value(200), "Measured calls per size class, cold")
+        ("cold-buffer", po::value<size_t>()->default_value(4096), "KiB written between two cold calls")
+        ("warmup,w", po::value<size_t>()->default_value(100000), "Random malloc/free calls to fragment the heap first")
+        (",o", po::value<std::string>(), "Output csv file, default is stdout");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cerr << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+
+    MicroConfig config;
+    config.samples = std::max((size_t) 1, vm["samples"].as<size_t>());
+    config.coldSamples = std::max((size_t) 1, vm["cold-samples"].as<size_t>());
+    config.coldBufferSize = vm["cold-buffer"].as<size_t>() * 1024;
+    config.warmup = vm["warmup"].as<size_t>();
+
+    std::vector<size_t> sizes;
+    for (const std::string& size : splitList(vm["sizes"].as<std::string>())) {
+        sizes.push_back(std::max((size_t) 1, (size_t) std::stoul(size)));
+    }
+
+    std::ofstream file;
+    if (vm.count("-o")) {
+        file.open(vm["-o"].as<std::string>(), std::ofstream::trunc);
+    }
+    std::ostream& out = vm.count("-o") ? file : std::cout;
+
+    //everything the measurements need is set up before the first call
+    size_t capacity = std::max(config.samples, config.coldSamples);
+    LatencyRecorder recorders[NUMBER_OF_MICRO_OPS] = {
+        LatencyRecorder(capacity), LatencyRecorder(capacity), LatencyRecorder(capacity), LatencyRecorder(capacity)
+    };
+    void** objects = (void**) mapArray(capacity * sizeof(void*));
+    void** live = (void**) mapArray(WARMUP_OBJECTS * sizeof(void*));
+    CacheEvictor evictor(config.coldBufferSize);
+
+    LatencyRecorder timerOverhead(config.samples);
+    CycleTimer timer;
+    for (size_t i = 0; i < config.samples; i++) {
+        timer.start();
+        timerOverhead.add(timer.stop());
+    }
+    timerOverhead.sort();
+    out << "# timer overhead p50 = " << timerOverhead.perMille(500) << " ticks, warmup = " << config.warmup << std::endl;
+    out << "heap,op,size,mode,samples,failed,p50,p99,p999,max" << std::endl;
+
+    LibcHeap libcHeap;
+    FixedMemory<FIXED_MICRO_MEMORY> fixedMemory;
+    FixedHeap<FIXED_MICRO_BLOCK> fixedHeap(fixedMemory);
+
+    for (const std::string& heapName : splitList(vm["heaps"].as<std::string>())) {
+        Heap* target;
+        if (heapName == "libc") {
+            target = &libcHeap;
+        } else if (heapName == "firstfit") {
+            target = &heap;
+        } else if (heapName == "fixed") {
+            fixedMemory.initMem();
+            fixedHeap.initHeap();
+            target = &fixedHeap;
+        } else {
+            std::cerr << "|###> Error: unknown heap " << heapName << std::endl;
+            return 1;
+        }
+
+        std::fill(live, live + WARMUP_OBJECTS, (void*) NULL);
+        fragment(*target, live, config.warmup);
+
+        for (size_t size : sizes) {
+            for (int cold = 0; cold <= 1; cold++) {
+                size_t samples = cold ? config.coldSamples : config.samples;
+                measure(*target, size, samples, cold ? &evictor : NULL, objects, recorders);
+
+                for (int op = 0; op < NUMBER_OF_MICRO_OPS; op++) {
+                    LatencyRecorder& recorder = recorders[op];
+                    recorder.sort();
+                    out << heapName << "," << opNames[op] << "," << size << "," << (cold ? "cold" : "hot") << ","
+                        << recorder.count << "," << recorder.failed << "," << recorder.perMille(500) << "," << recorder.perMille(990) << ","
+                        << recorder.perMille(999) << "," << recorder.perMille(1000) << std::endl;
+                    recorder.clear();
+                }
+            }
+        }
+
+        for (size_t i = 0; i < WARMUP_OBJECTS; i++) {
+            target->free(live[i]);
+        }
+    }
+    return 0;
+}
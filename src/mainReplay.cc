@@ -0,0 +1,327 @@
+/*
+ * mainReplay.cc
+ *
+ * Replays an allocation trace that libMemAlloc.so recorded with
+ * MEMALLOC_TRACE=<file> against one of the heaps and reports the time,
+ * the peak RSS and the external fragmentation (1 - largest free block / free bytes).
+ *
+ * The records of all threads are merged by their timestamps and replayed in
+ * one thread. The tool keeps its own tables in mmap'ed memory, so they don't
+ * disturb the heap under test.
+ */
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "timer/CycleTimer.h"
+#include "misc/AllocationTrace.h"
+#include "runtime/Memalloc.h"
+#include "runtime/FixedHeap.h"
+#include "system/FixedMemory.h"
+
+//memory and block size of the FixedHeap variant
+#define FIXED_REPLAY_MEMORY (16 * 1024 * 1024)
+#define FIXED_REPLAY_BLOCK 64
+
+//pages of an allocation are written once, so they count for the RSS
+#define REPLAY_PAGE_SIZE 4096
+
+extern FirstFitHeap heap;
+
+namespace po = boost::program_options;
+
+struct ReplayOp
+{
+    uint64_t tick;
+    uint64_t sequence;      //position in the file, keeps the order of records with the same tick
+    const AllocRecord* record;
+
+    bool operator<(const ReplayOp& other) const
+    {
+        return tick < other.tick || (tick == other.tick && sequence < other.sequence);
+    }
+};
+
+struct ReplayTrace
+{
+    ReplayOp* ops;
+    size_t count;
+    uint32_t maxId;
+};
+
+struct ReplayResult
+{
+    uint64_t ticks;
+    double seconds;
+    size_t failed;              //allocations the heap couldn't serve
+    size_t skipped;             //records about objects allocated before the recording started
+    uint64_t peakLiveBytes;
+    long startRssKB;
+    long peakRssKB;
+    double meanFragmentation;
+    double maxFragmentation;
+    double endFragmentation;
+};
+
+//zeroed memory outside of the heap under test
+static void* mapArray(size_t bytes)
+{
+    void* array = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (array == MAP_FAILED) {
+        std::cerr << "|###> Error: can't map " << bytes << " bytes for the replay" << std::endl;
+        exit(1);
+    }
+    return array;
+}
+
+static long peakRss()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static double fragmentation(Heap& target)
+{
+    size_t freeBytes = target.getFreeBytes();
+    if (freeBytes == 0) {
+        return 0;
+    }
+    return 1.0 - (double) target.getLargestFreeBlock() / freeBytes;
+}
+
+static void touch(void* ptr, size_t size)
+{
+    for (size_t offset = 0; offset < size; offset += REPLAY_PAGE_SIZE) {
+        ((volatile char*) ptr)[offset] = 1;
+    }
+}
+
+/**
+ * Maps the trace file and merges the chunks of all threads by their timestamps.
+ */
+static bool loadTrace(const std::string& fileName, ReplayTrace* trace)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(AllocTraceHeader)) {
+        std::cerr << "|###> Error: can't read the trace " << fileName << std::endl;
+        return false;
+    }
+
+    const char* data = (const char*) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "|###> Error: can't map the trace " << fileName << std::endl;
+        return false;
+    }
+
+    const AllocTraceHeader* header = (const AllocTraceHeader*) data;
+    if (header->magic != ALLOC_TRACE_MAGIC || header->version != ALLOC_TRACE_VERSION) {
+        std::cerr << "|###> Error: " << fileName << " is not an allocation trace" << std::endl;
+        return false;
+    }
+    const char* begin = data + sizeof(AllocTraceHeader);
+    const char* end = data + info.st_size;
+
+    //first pass counts the records, the second one computes their absolute ticks
+    trace->count = 0;
+    for (const char* pos = begin; pos + sizeof(AllocTraceChunk) <= end; ) {
+        const AllocTraceChunk* chunk = (const AllocTraceChunk*) pos;
+        pos += sizeof(AllocTraceChunk) + chunk->count * sizeof(AllocRecord);
+        if (pos > end) {
+            std::cerr << "|###> Warning: the trace is truncated" << std::endl;
+            break;
+        }
+        trace->count += chunk->count;
+    }
+
+    trace->ops = (ReplayOp*) mapArray(trace->count * sizeof(ReplayOp) + 1);
+    trace->maxId = 0;
+    size_t n = 0;
+    for (const char* pos = begin; n < trace->count; ) {
+        const AllocTraceChunk* chunk = (const AllocTraceChunk*) pos;
+        const AllocRecord* records = (const AllocRecord*) (pos + sizeof(AllocTraceChunk));
+        uint64_t tick = chunk->startTick;
+
+        for (uint32_t i = 0; i < chunk->count; i++, n++) {
+            tick += records[i].delta;
+            trace->ops[n].tick = tick;
+            trace->ops[n].sequence = n;
+            trace->ops[n].record = &records[i];
+            trace->maxId = std::max(trace->maxId, std::max(records[i].id, records[i].oldId));
+        }
+        pos += sizeof(AllocTraceChunk) + chunk->count * sizeof(AllocRecord);
+    }
+
+    std::sort(trace->ops, trace->ops + trace->count);
+    return true;
+}
+
+/**
+ * Drives the heap with all records of the trace.
+ *
+ * @param sampleInterval number of records between two fragmentation samples, 0 only samples at the end
+ * @param touchPages write to every page of an allocation
+ */
+static ReplayResult replay(Heap& target, const ReplayTrace& trace, size_t sampleInterval, bool touchPages)
+{
+    ReplayResult result = ReplayResult();
+    void** pointers = (void**) mapArray((trace.maxId + 1) * sizeof(void*));
+    uint64_t* sizes = (uint64_t*) mapArray((trace.maxId + 1) * sizeof(uint64_t));
+    uint64_t liveBytes = 0;
+    size_t samples = 0;
+    double fragmentationSum = 0;
+
+    result.startRssKB = peakRss();
+    CycleTimer timer;
+    std::chrono::steady_clock::duration elapsed(0);
+
+    auto start = std::chrono::steady_clock::now();
+    timer.start();
+    for (size_t i = 0; i < trace.count; i++) {
+        const AllocRecord* record = trace.ops[i].record;
+        void* ptr = NULL;
+
+        switch (record->op) {
+        case ALLOC_MALLOC:
+            ptr = target.malloc(record->size);
+            break;
+        case ALLOC_CALLOC:
+            ptr = target.calloc(record->size, 1);
+            break;
+        case ALLOC_REALLOC:
+            if (record->oldId != 0) {
+                if (pointers[record->oldId] == NULL) {
+                    result.skipped++;
+                    continue;
+                }
+                ptr = target.realloc(pointers[record->oldId], record->size);
+                if (ptr == NULL && record->size != 0) {
+                    result.failed++;
+                    continue;
+                }
+                liveBytes -= sizes[record->oldId];
+                pointers[record->oldId] = NULL;
+            } else {
+                ptr = target.malloc(record->size);
+            }
+            break;
+        case ALLOC_FREE:
+            if (pointers[record->id] == NULL) {
+                result.skipped++;
+            } else {
+                target.free(pointers[record->id]);
+                liveBytes -= sizes[record->id];
+                pointers[record->id] = NULL;
+            }
+            break;
+        }
+
+        if (record->op != ALLOC_FREE && record->id != 0) {
+            if (ptr == NULL) {
+                result.failed++;
+            } else {
+                if (touchPages) {
+                    touch(ptr, record->size);
+                }
+                pointers[record->id] = ptr;
+                sizes[record->id] = record->size;
+                liveBytes += record->size;
+                result.peakLiveBytes = std::max(result.peakLiveBytes, liveBytes);
+            }
+        }
+
+        //the samples walk the heap, they are not part of the measured time
+        if (sampleInterval != 0 && (i + 1) % sampleInterval == 0) {
+            result.ticks += timer.stop();
+            elapsed += std::chrono::steady_clock::now() - start;
+
+            double current = fragmentation(target);
+            fragmentationSum += current;
+            result.maxFragmentation = std::max(result.maxFragmentation, current);
+            samples++;
+
+            start = std::chrono::steady_clock::now();
+            timer.start();
+        }
+    }
+    result.ticks += timer.stop();
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    result.seconds = std::chrono::duration<double>(elapsed).count();
+    result.peakRssKB = peakRss();
+    result.endFragmentation = fragmentation(target);
+    result.maxFragmentation = std::max(result.maxFragmentation, result.endFragmentation);
+    result.meanFragmentation = samples == 0 ? result.endFragmentation : fragmentationSum / samples;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Replays an allocation trace (record one with MEMALLOC_TRACE=<file> and libMemAlloc.so)");
+    desc.add_options()
+        ("help,h", "Print help message")
+        ("trace,t", po::value<std::string>()->required(), "Trace file to replay")
+        ("heap", po::value<std::string>()->default_value("firstfit"), "Heap to drive: firstfit or fixed")
+        ("sample,s", po::value<size_t>()->default_value(10000), "Sample the fragmentation every <arg> records, 0 only at the end")
+        ("no-touch", "Don't write to the allocated pages")
+        ("csv", "Print one csv line instead of the report");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cerr << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+    std::string traceName = vm["trace"].as<std::string>();
+    std::string heapName = vm["heap"].as<std::string>();
+
+    FixedMemory<FIXED_REPLAY_MEMORY> fixedMemory;
+    FixedHeap<FIXED_REPLAY_BLOCK> fixedHeap(fixedMemory);
+    Heap* target;
+    if (heapName == "firstfit") {
+        target = &heap;
+    } else if (heapName == "fixed") {
+        fixedMemory.initMem();
+        fixedHeap.initHeap();
+        target = &fixedHeap;
+    } else {
+        std::cerr << "|###> Error: unknown heap " << heapName << std::endl;
+        return 1;
+    }
+
+    ReplayTrace trace;
+    if (!loadTrace(traceName, &trace)) {
+        return 1;
+    }
+
+    ReplayResult result = replay(*target, trace, vm["sample"].as<size_t>(), !vm.count("no-touch"));
+
+    if (vm.count("csv")) {
+        std::cout << "# heap,records,ticks,seconds,failed,skipped,peakLiveBytes,startRssKB,peakRssKB,meanFragmentation,maxFragmentation,endFragmentation" << std::endl;
+        std::cout << heapName << "," << trace.count << "," << result.ticks << "," << result.seconds << ","
+            << result.failed << "," << result.skipped << "," << result.peakLiveBytes << ","
+            << result.startRssKB << "," << result.peakRssKB << "," << result.meanFragmentation << ","
+            << result.maxFragmentation << "," << result.endFragmentation << std::endl;
+    } else {
+        std::cout << "heap:                 " << heapName << std::endl;
+        std::cout << "records:              " << trace.count << std::endl;
+        std::cout << "time:                 " << result.seconds << " s (" << result.ticks << " ticks)" << std::endl;
+        std::cout << "failed allocations:   " << result.failed << std::endl;
+        std::cout << "skipped records:      " << result.skipped << std::endl;
+        std::cout << "peak live bytes:      " << result.peakLiveBytes << std::endl;
+        std::cout << "peak RSS:             " << result.peakRssKB << " KiB (" << result.startRssKB << " KiB before the replay)" << std::endl;
+        std::cout << "fragmentation:        mean " << result.meanFragmentation << ", max " << result.maxFragmentation
+            << ", end " << result.endFragmentation << std::endl;
+    }
+    return 0;
+}
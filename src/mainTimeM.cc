@@ -176,6 +176,7 @@ int main(int argc, char** argv)
         {   
 			vMem.resetQueues();
             //initialize the VirtualMem with the current maxChunkAvailable
+            vMem.setFrameBudget(decreasableMaxChunkNumber);
             vMem.initializeVirtualMem(writeBackAll);
             //store the start address of each block in the array
             unsigned* memStart = static_cast<unsigned*>(vMem.getStart());
@@ -0,0 +1,293 @@
+#include "misc/AllocationTrace.h"
+#include "timer/cycle.h"
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define RECORDER_TABLE_SIZE ((size_t) 1 << RECORDER_TABLE_BITS)
+
+//index of the buffer the calling thread claimed, -1 before its first record
+static thread_local int ownBufferIndex = -1;
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* pos = (const char*) data;
+    while (size > 0) {
+        ssize_t written = write(fd, pos, size);
+        if (written <= 0) {
+            return false;
+        }
+        pos += written;
+        size -= written;
+    }
+    return true;
+}
+
+static size_t hashAddress(const void* address)
+{
+    return (size_t) ((((uint64_t) address) >> 4) * 0x9E3779B97F4A7C15ull) >> (64 - RECORDER_TABLE_BITS);
+}
+
+AllocationRecorder::AllocationRecorder()
+    : enabled(false), fd(-1), bufferKeyCreated(false), tableKeys(NULL), tableIds(NULL), tableUsed(0), nextId(1), lostRecords(0)
+{
+    //a recorder that is not a global doesn't start with zeroed buffers
+    for (unsigned i = 0; i < MAX_RECORD_THREADS; i++) {
+        buffers[i].claimed.store(false, std::memory_order_relaxed);
+        buffers[i].count = 0;
+        buffers[i].records = NULL;
+    }
+
+    const char* pattern = getenv("MEMALLOC_TRACE");
+    if (pattern == NULL || *pattern == '\0') {
+        return;
+    }
+
+    //"%p" is replaced by the process id, child processes inherit the variable
+    char path[PATH_MAX];
+    size_t length = 0;
+    for (const char* pos = pattern; *pos != '\0' && length < sizeof(path) - 1; pos++) {
+        if (pos[0] == '%' && pos[1] == 'p') {
+            int written = snprintf(path + length, sizeof(path) - length, "%d", (int) getpid());
+            length = std::min(length + written, sizeof(path) - 1);
+            pos++;
+        } else {
+            path[length++] = *pos;
+        }
+    }
+    path[length] = '\0';
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("MEMALLOC_TRACE");
+        return;
+    }
+
+    //only the touched part of the table gets physical memory
+    void* keys = mmap(NULL, RECORDER_TABLE_SIZE * sizeof(void*), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    void* ids = mmap(NULL, RECORDER_TABLE_SIZE * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (keys == MAP_FAILED || ids == MAP_FAILED) {
+        perror("MEMALLOC_TRACE: mmap");
+        close(fd);
+        fd = -1;
+        return;
+    }
+    tableKeys = (const void**) keys;
+    tableIds = (uint32_t*) ids;
+    //pthread keys don't allocate, unlike a thread_local with a destructor
+    bufferKeyCreated = pthread_key_create(&bufferKey, releaseBuffer) == 0;
+
+    AllocTraceHeader header = {ALLOC_TRACE_MAGIC, ALLOC_TRACE_VERSION};
+    writeAll(fd, &header, sizeof(header));
+    enabled.store(true, std::memory_order_release);
+}
+
+AllocationRecorder::~AllocationRecorder()
+{
+    if (!enabled.exchange(false)) {
+        return;
+    }
+
+    for (unsigned i = 0; i < MAX_RECORD_THREADS; i++) {
+        if (buffers[i].claimed.load(std::memory_order_acquire) && buffers[i].count > 0) {
+            flush(&buffers[i]);
+        }
+    }
+    close(fd);
+    if (bufferKeyCreated) {
+        pthread_key_delete(bufferKey);
+    }
+
+    unsigned lost = lostRecords.load(std::memory_order_relaxed);
+    if (lost != 0) {
+        char line[128];
+        int length = snprintf(line, sizeof(line), "MEMALLOC_TRACE: %u calls not recorded, too many threads or live objects\n", lost);
+        writeAll(STDERR_FILENO, line, length);
+    }
+}
+
+void AllocationRecorder::append(alloc_op op, const void* result, const void* old, size_t size, uint32_t oldId)
+{
+    //the block stays where it was if realloc failed
+    if (op == ALLOC_REALLOC && result == NULL && size != 0 && oldId != 0) {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        restoreId(old, oldId);
+    }
+    //calls that failed or did nothing don't change the heap, they are not recorded
+    if ((op == ALLOC_FREE && old == NULL) || (op != ALLOC_FREE && result == NULL && !(op == ALLOC_REALLOC && old != NULL && size == 0))) {
+        return;
+    }
+
+    Buffer* buffer = ownBuffer();
+    if (buffer == NULL) {
+        lostRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t id = 0;
+    uint64_t now;
+    {
+        //the tick is taken under the lock, so sorting by ticks keeps the order of an id's calls
+        std::lock_guard<std::mutex> lock(tableMutex);
+        if (op == ALLOC_FREE) {
+            id = removeId(old);
+        } else {
+            if (result != NULL) {
+                id = insertId(result);
+            }
+        }
+        now = getticks();
+    }
+
+    if ((op == ALLOC_FREE && id == 0) || (op != ALLOC_FREE && result != NULL && id == 0)) {
+        lostRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    //a delta has 32 bits, after a longer pause the thread starts a new chunk
+    if (buffer->count > 0 && now - buffer->lastTick > UINT32_MAX) {
+        flush(buffer);
+    }
+    if (buffer->count == 0) {
+        buffer->startTick = now;
+        buffer->lastTick = now;
+    }
+
+    AllocRecord* record = &buffer->records[buffer->count++];
+    record->size = size;
+    record->id = id;
+    record->oldId = oldId;
+    record->delta = (uint32_t) (now - buffer->lastTick);
+    record->op = op;
+    buffer->lastTick = now;
+
+    if (buffer->count == RECORD_BUFFER_SIZE) {
+        flush(buffer);
+    }
+}
+
+AllocationRecorder::Buffer* AllocationRecorder::ownBuffer()
+{
+    if (ownBufferIndex >= 0) {
+        return &buffers[ownBufferIndex];
+    }
+
+    for (unsigned i = 0; i < MAX_RECORD_THREADS; i++) {
+        bool expected = false;
+        if (buffers[i].claimed.compare_exchange_strong(expected, true)) {
+            //a buffer that was given back keeps its records mapped
+            if (buffers[i].records == NULL) {
+                void* records = mmap(NULL, RECORD_BUFFER_SIZE * sizeof(AllocRecord), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (records == MAP_FAILED) {
+                    buffers[i].claimed.store(false, std::memory_order_release);
+                    return NULL;
+                }
+                buffers[i].records = (AllocRecord*) records;
+            }
+            buffers[i].recorder = this;
+            buffers[i].count = 0;
+            ownBufferIndex = i;
+            if (bufferKeyCreated) {
+                pthread_setspecific(bufferKey, &buffers[i]);
+            }
+            return &buffers[i];
+        }
+    }
+    return NULL;
+}
+
+//the thread exits, its records are written before the next thread takes the buffer
+void AllocationRecorder::releaseBuffer(void* data)
+{
+    Buffer* buffer = (Buffer*) data;
+    ownBufferIndex = -1;
+    if (buffer->recorder->enabled.load(std::memory_order_acquire) && buffer->count > 0) {
+        buffer->recorder->flush(buffer);
+    }
+    buffer->claimed.store(false, std::memory_order_release);
+}
+
+void AllocationRecorder::flush(Buffer* buffer)
+{
+    AllocTraceChunk chunk;
+    chunk.thread = (uint32_t) (buffer - buffers);
+    chunk.count = buffer->count;
+    chunk.startTick = buffer->startTick;
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    writeAll(fd, &chunk, sizeof(chunk));
+    writeAll(fd, buffer->records, buffer->count * sizeof(AllocRecord));
+    buffer->count = 0;
+}
+
+//slot of the address or the empty slot where it would be inserted
+size_t AllocationRecorder::findSlot(const void* address)
+{
+    size_t slot = hashAddress(address);
+    while (tableKeys[slot] != NULL && tableKeys[slot] != address) {
+        slot = (slot + 1) & (RECORDER_TABLE_SIZE - 1);
+    }
+    return slot;
+}
+
+uint32_t AllocationRecorder::insertId(const void* address)
+{
+    //keep the table at most 3/4 full, otherwise the probe sequences get too long
+    if (tableUsed >= RECORDER_TABLE_SIZE / 4 * 3 || nextId == 0) {
+        return 0;
+    }
+
+    size_t slot = findSlot(address);
+    if (tableKeys[slot] == NULL) {
+        tableKeys[slot] = address;
+        tableUsed++;
+    }
+    tableIds[slot] = nextId++;
+    return tableIds[slot];
+}
+
+//gives a block its id back, its address was not handed out again in between
+void AllocationRecorder::restoreId(const void* address, uint32_t id)
+{
+    size_t slot = findSlot(address);
+    if (tableKeys[slot] == NULL) {
+        tableKeys[slot] = address;
+        tableUsed++;
+    }
+    tableIds[slot] = id;
+}
+
+uint32_t AllocationRecorder::removeId(const void* address)
+{
+    size_t slot = findSlot(address);
+    if (tableKeys[slot] == NULL) {
+        return 0;
+    }
+    uint32_t id = tableIds[slot];
+
+    //backward shift deletion, moves entries of the probe sequence into the gap
+    size_t next = slot;
+    while (true) {
+        next = (next + 1) & (RECORDER_TABLE_SIZE - 1);
+        if (tableKeys[next] == NULL) {
+            break;
+        }
+        size_t home = hashAddress(tableKeys[next]);
+        bool stays = (slot < next) ? (home > slot && home <= next) : (home > slot || home <= next);
+        if (!stays) {
+            tableKeys[slot] = tableKeys[next];
+            tableIds[slot] = tableIds[next];
+            slot = next;
+        }
+    }
+    tableKeys[slot] = NULL;
+    tableUsed--;
+    return id;
+}
@@ -0,0 +1,180 @@
+#include "misc/PageCompressor.h"
+#include <cstring>
+#include <cstdint>
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+static inline uint32_t read32(const char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline unsigned hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - COMPRESSOR_HASH_BITS);
+}
+
+//appends the extension bytes of a length whose nibble is 15
+static inline bool putLength(char*& out, char* end, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (out == end)
+            return false;
+        *out++ = (char) 255;
+    }
+    if (out == end)
+        return false;
+    *out++ = (char) length;
+    return true;
+}
+
+static bool putSequence(char*& out, char* end, const char* literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    if (out == end)
+        return false;
+    char* token = out++;
+    size_t matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    *token = (char) (((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (literalLength >= 15 && !putLength(out, end, literalLength - 15))
+        return false;
+    if ((size_t) (end - out) < literalLength)
+        return false;
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength == 0)
+        return true;
+
+    if (end - out < 2)
+        return false;
+    *out++ = (char) (offset & 0xFF);
+    *out++ = (char) (offset >> 8);
+    return matchCode < 15 || putLength(out, end, matchCode - 15);
+}
+
+size_t PageCompressor::compress(const char* source, size_t size, char* destination, size_t capacity)
+{
+    for (unsigned i = 0; i < (1 << COMPRESSOR_HASH_BITS); i++)
+    {
+        table[i] = -1;
+    }
+    char* out = destination;
+    char* end = destination + capacity;
+    size_t anchor = 0;
+    size_t position = 0;
+
+    while (position + MIN_MATCH <= size)
+    {
+        uint32_t sequence = read32(source + position);
+        unsigned slot = hash(sequence);
+        int candidate = table[slot];
+        table[slot] = (int) position;
+
+        if (candidate < 0 || position - candidate > MAX_OFFSET || read32(source + candidate) != sequence)
+        {
+            //data without matches is skipped faster the longer it gets
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+
+        //8 bytes per comparison, on little endian the first different byte is the lowest one of the xor
+        size_t length = MIN_MATCH;
+        bool differs = false;
+        while (!differs && position + length + 8 <= size)
+        {
+            uint64_t left, right;
+            memcpy(&left, source + candidate + length, 8);
+            memcpy(&right, source + position + length, 8);
+            if (left != right)
+            {
+                length += __builtin_ctzll(left ^ right) >> 3;
+                differs = true;
+            }
+            else
+            {
+                length += 8;
+            }
+        }
+        while (!differs && position + length < size && source[candidate + length] == source[position + length])
+        {
+            length++;
+        }
+        if (!putSequence(out, end, source + anchor, position - anchor, position - candidate, length))
+        {
+            return 0;
+        }
+        position += length;
+        anchor = position;
+    }
+
+    if (!putSequence(out, end, source + anchor, size - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return out - destination;
+}
+
+//reads the extension bytes of a length whose nibble is 15
+static inline bool getLength(const char*& in, const char* end, size_t& length)
+{
+    unsigned char byte;
+    do
+    {
+        if (in == end)
+            return false;
+        byte = (unsigned char) *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool PageCompressor::decompress(const char* source, size_t length, char* destination, size_t size)
+{
+    const char* in = source;
+    const char* end = source + length;
+    size_t out = 0;
+
+    while (in < end)
+    {
+        unsigned char token = (unsigned char) *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !getLength(in, end, literalLength))
+            return false;
+        if ((size_t) (end - in) < literalLength || size - out < literalLength)
+            return false;
+        memcpy(destination + out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+        //the last sequence has no match
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return false;
+        size_t offset = (unsigned char) in[0] | ((size_t) (unsigned char) in[1] << 8);
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !getLength(in, end, matchLength))
+            return false;
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > out || size - out < matchLength)
+            return false;
+        //a match may overlap the bytes it produces, then it repeats them
+        if (offset >= matchLength)
+        {
+            memcpy(destination + out, destination + out - offset, matchLength);
+            out += matchLength;
+        }
+        else
+        {
+            for (size_t i = 0; i < matchLength; i++, out++)
+            {
+                destination[out] = destination[out - offset];
+            }
+        }
+    }
+    return out == size;
+}
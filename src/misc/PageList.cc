@@ -0,0 +1,151 @@
+#include "misc/PageList.h"
+#include <sys/mman.h>
+
+#define MARK 0x80
+#define OWNER 0x7F
+
+template <typename T>
+static T* mapArray(size_t elements)
+{
+    void* array = mmap(NULL, elements * sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return array == MAP_FAILED ? NULL : (T*) array;
+}
+
+bool PageLinks::create(void* start, size_t pageSize, size_t pages)
+{
+    this->start = (char*) start;
+    this->pageSize = pageSize;
+    this->pages = pages;
+    previous = mapArray<unsigned>(pages);
+    next = mapArray<unsigned>(pages);
+    //fresh anonymous memory is zero: no page is in a list
+    owner = mapArray<unsigned char>(pages);
+    return previous != NULL && next != NULL && owner != NULL;
+}
+
+void PageLinks::destroy()
+{
+    if (previous != NULL)
+        munmap(previous, pages * sizeof(unsigned));
+    if (next != NULL)
+        munmap(next, pages * sizeof(unsigned));
+    if (owner != NULL)
+        munmap(owner, pages);
+    previous = next = NULL;
+    owner = NULL;
+}
+
+unsigned PageLinks::pageIndex(void* page)
+{
+    return (unsigned) (((char*) page - start) / pageSize);
+}
+
+void* PageLinks::pageAddress(unsigned index)
+{
+    return start + (size_t) index * pageSize;
+}
+
+bool PageLinks::isMarked(void* page)
+{
+    return (owner[pageIndex(page)] & MARK) != 0;
+}
+
+void PageLinks::setMarked(void* page, bool marked)
+{
+    unsigned index = pageIndex(page);
+    owner[index] = marked ? (owner[index] | MARK) : (owner[index] & OWNER);
+}
+
+PageList::PageList(PageLinks& links, unsigned char id) : links(links), id(id)
+{
+}
+
+void PageList::enqueue(void* page)
+{
+    unsigned index = links.pageIndex(page);
+    links.previous[index] = rear;
+    links.next[index] = NO_PAGE;
+    links.owner[index] = (links.owner[index] & MARK) | id;
+
+    if (rear == NO_PAGE)
+        front = index;
+    else
+        links.next[rear] = index;
+    rear = index;
+    count++;
+}
+
+void* PageList::dequeue()
+{
+    if (checkEmpty())
+    {
+        return NULL;
+    }
+    void* page = links.pageAddress(front);
+    remove(page);
+    return page;
+}
+
+void* PageList::peek()
+{
+    if (checkEmpty())
+    {
+        return NULL;
+    }
+    return links.pageAddress(front);
+}
+
+bool PageList::contains(void* page)
+{
+    return (links.owner[links.pageIndex(page)] & OWNER) == id;
+}
+
+bool PageList::remove(void* page)
+{
+    if (!contains(page))
+    {
+        return false;
+    }
+    unsigned index = links.pageIndex(page);
+    unsigned before = links.previous[index];
+    unsigned after = links.next[index];
+
+    if (before == NO_PAGE)
+        front = after;
+    else
+        links.next[before] = after;
+    if (after == NO_PAGE)
+        rear = before;
+    else
+        links.previous[after] = before;
+
+    links.owner[index] &= MARK;
+    count--;
+    return true;
+}
+
+void PageList::moveToRear(void* page)
+{
+    if (remove(page))
+    {
+        enqueue(page);
+    }
+}
+
+void PageList::clear()
+{
+    while (!checkEmpty())
+    {
+        dequeue();
+    }
+}
+
+size_t PageList::size()
+{
+    return count;
+}
+
+bool PageList::checkEmpty()
+{
+    return count == 0;
+}
@@ -0,0 +1,231 @@
+#include "misc/TraceRing.h"
+#include "timer/cycle.h"
+#include <cstdint>
+#include <pthread.h>
+#include <sched.h>
+
+//the rings live in static storage, a thread claims one on its first event and gives it back when it exits
+static TraceRing traceRings[MAX_TRACE_THREADS];
+static thread_local TraceRing* ownRing = NULL;
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+static std::atomic<unsigned> lostEvents(0);
+static std::atomic<bool> traceVerbose(false);
+//traceDrain runs in the SIGSEGV handler, it can't take a mutex
+static std::atomic_flag drainBusy = ATOMIC_FLAG_INIT;
+static thread_local bool drainingHere = false;
+
+static const char* traceMessages[TRACE_NUMBER_OF_EVENTS] = {
+    "own new",
+    "own realloc",
+    "realloc of a null pointer, behaves like malloc",
+    "Error: Please dont use a 0!",
+    "Error: cant calloc 0",
+    "Error: There is not enough memory available.",
+    "Error: Address to free is outside of the heap",
+    "Error: address to free is not correct",
+    "Error: Please enter the first element of the memory blocks!",
+    "Error: address to realloc is not correct",
+    "Error: Your heap is corrupted!",
+    "Error: double free of a block",
+    "Error: block canary is corrupted (size = found canary)",
+    "|### Error: Access denied, unmapped @ address",
+    "|### Error: fault while the memory is locked by the same thread @ address",
+    "|### Error: transfer of the swap file failed, the pages are lost @ address"
+};
+
+void TraceRing::push(trace_event code, const void* address, size_t size, unsigned long long tick)
+{
+    //a signal handler can push between the load and the CAS, then the slot is taken again
+    unsigned h = head.load(std::memory_order_relaxed);
+    do {
+        if (h - tail.load(std::memory_order_acquire) == TRACE_RING_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!head.compare_exchange_weak(h, h + 1, std::memory_order_relaxed));
+
+    unsigned slot = h & (TRACE_RING_SIZE - 1);
+    TraceEvent* event = &events[slot];
+    event->tick = tick;
+    event->address = address;
+    event->size = size;
+    event->code = code;
+    written[slot].store(h + 1, std::memory_order_release);
+}
+
+bool TraceRing::pop(TraceEvent* event)
+{
+    unsigned t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_relaxed)
+            || written[t & (TRACE_RING_SIZE - 1)].load(std::memory_order_acquire) != t + 1) {
+        return false;
+    }
+
+    *event = events[t & (TRACE_RING_SIZE - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+//the events of an exiting thread stay in its ring until the next drain, the next owner appends to them
+static void releaseRing(void* ring)
+{
+    ownRing = NULL;
+    ((TraceRing*) ring)->claimed.store(false, std::memory_order_release);
+}
+
+//pthread keys don't allocate, a thread_local with a destructor would call malloc on the first event
+static void createRingKey()
+{
+    pthread_key_create(&ringKey, releaseRing);
+}
+
+//claims a free ring for the calling thread, NULL if all rings are taken
+static TraceRing* claimRing()
+{
+    pthread_once(&ringKeyOnce, createRingKey);
+    for (unsigned i = 0; i < MAX_TRACE_THREADS; i++) {
+        bool expected = false;
+        if (traceRings[i].claimed.compare_exchange_strong(expected, true)) {
+            pthread_setspecific(ringKey, &traceRings[i]);
+            return &traceRings[i];
+        }
+    }
+    return NULL;
+}
+
+void traceSetVerbose(bool verbose)
+{
+    traceVerbose.store(verbose, std::memory_order_relaxed);
+}
+
+void traceEvent(trace_event code, const void* address, size_t size)
+{
+    if (code < TRACE_FIRST_ERROR && !traceVerbose.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (ownRing == NULL) {
+        ownRing = claimRing();
+        if (ownRing == NULL) {
+            lostEvents.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    ownRing->push(code, address, size, getticks());
+}
+
+//a line of the drain output, formatted without stdio which is not async-signal-safe
+struct TraceLine
+{
+    char text[160];
+    size_t length = 0;
+
+    void append(const char* string)
+    {
+        while (*string != '\0' && length < sizeof(text)) {
+            text[length++] = *string++;
+        }
+    }
+
+    void appendDecimal(unsigned long long value)
+    {
+        char digits[20];
+        unsigned count = 0;
+        do {
+            digits[count++] = (char) ('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (count > 0 && length < sizeof(text)) {
+            text[length++] = digits[--count];
+        }
+    }
+
+    void appendHex(uintptr_t value)
+    {
+        char digits[2 * sizeof(uintptr_t)];
+        unsigned count = 0;
+        do {
+            digits[count++] = "0123456789abcdef"[value & 15];
+            value >>= 4;
+        } while (value != 0);
+        append("0x");
+        while (count > 0 && length < sizeof(text)) {
+            text[length++] = digits[--count];
+        }
+    }
+
+    void write(int fd)
+    {
+        ssize_t ignored = ::write(fd, text, length);
+        (void) ignored;
+        length = 0;
+    }
+};
+
+size_t traceDrain(int fd, bool verbose)
+{
+    //a fault of this thread while it drains would wait for itself
+    if (drainingHere) {
+        return 0;
+    }
+    while (drainBusy.test_and_set(std::memory_order_acquire)) {
+        sched_yield();
+    }
+    drainingHere = true;
+
+    TraceLine line;
+    size_t drained = 0;
+    TraceEvent event;
+
+    for (unsigned i = 0; i < MAX_TRACE_THREADS; i++) {
+        //a ring that was given back may still hold the events of its last owner
+        while (traceRings[i].pop(&event)) {
+            drained++;
+            if (!verbose && event.code < TRACE_FIRST_ERROR) {
+                continue;
+            }
+            line.append("[");
+            line.appendDecimal(event.tick);
+            line.append("] thread ");
+            line.appendDecimal(i);
+            line.append(": ");
+            line.append(traceMessages[event.code]);
+            line.append(" (address = ");
+            line.appendHex((uintptr_t) event.address);
+            line.append(", size = ");
+            line.appendDecimal(event.size);
+            line.append(")\n");
+            line.write(fd);
+        }
+
+        unsigned dropped = traceRings[i].dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped != 0) {
+            line.append("thread ");
+            line.appendDecimal(i);
+            line.append(": ");
+            line.appendDecimal(dropped);
+            line.append(" trace events dropped, ring was full\n");
+            line.write(fd);
+        }
+    }
+
+    unsigned lost = lostEvents.exchange(0, std::memory_order_relaxed);
+    if (lost != 0) {
+        line.appendDecimal(lost);
+        line.append(" trace events lost, no free trace ring\n");
+        line.write(fd);
+    }
+
+    drainingHere = false;
+    drainBusy.clear(std::memory_order_release);
+    return drained;
+}
+
+void TraceDrainer::run()
+{
+    while (true) {
+        traceDrain(fd, verbose);
+        //usleep is a cancellation point for Thread::cancel()
+        usleep(intervalMicros);
+    }
+}
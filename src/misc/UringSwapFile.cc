@@ -0,0 +1,272 @@
+#include "misc/UringSwapFile.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+using namespace std;
+
+static int uringEnter(int ring, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, NULL, 0);
+}
+
+UringSwapFile::~UringSwapFile()
+{
+    close();
+}
+
+bool UringSwapFile::open(int fd, unsigned entries)
+{
+    this->fd = fd;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring < 0)
+    {
+        ring = -1;
+        return false;
+    }
+    //IORING_OP_READ and IORING_OP_WRITE came with the same kernel as this feature
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        close();
+        return false;
+    }
+
+    ringSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMapping)
+    {
+        ringSize = completionSize = ringSize > completionSize ? ringSize : completionSize;
+    }
+    ringMemory = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    completionMemory = singleMapping ? ringMemory
+        : mmap(NULL, completionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    submissionsSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    submissions = (struct io_uring_sqe*) mmap(NULL, submissionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (ringMemory == MAP_FAILED || completionMemory == MAP_FAILED || submissions == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    char* submissionRing = (char*) ringMemory;
+    submissionTail = (unsigned*) (submissionRing + params.sq_off.tail);
+    submissionMask = (unsigned*) (submissionRing + params.sq_off.ring_mask);
+    submissionArray = (unsigned*) (submissionRing + params.sq_off.array);
+    char* completionRing = (char*) completionMemory;
+    completionHead = (unsigned*) (completionRing + params.cq_off.head);
+    completionTail = (unsigned*) (completionRing + params.cq_off.tail);
+    completionMask = (unsigned*) (completionRing + params.cq_off.ring_mask);
+    completions = (struct io_uring_cqe*) (completionRing + params.cq_off.cqes);
+
+    //the completion ring has twice the entries, it can't overflow while inFlight <= entries
+    this->entries = params.sq_entries;
+    queued = inFlight = 0;
+    return true;
+}
+
+void UringSwapFile::close()
+{
+    if (ring == -1)
+    {
+        return;
+    }
+    if (submissionArray != NULL)
+    {
+        complete();
+    }
+    if (submissions != NULL && submissions != MAP_FAILED)
+        munmap(submissions, submissionsSize);
+    if (completionMemory != NULL && completionMemory != MAP_FAILED && completionMemory != ringMemory)
+        munmap(completionMemory, completionSize);
+    if (ringMemory != NULL && ringMemory != MAP_FAILED)
+        munmap(ringMemory, ringSize);
+    ::close(ring);
+    ring = -1;
+    ringMemory = completionMemory = NULL;
+    submissions = NULL;
+    submissionArray = NULL;
+    bufferCount = 0;
+}
+
+bool UringSwapFile::usesUring()
+{
+    return ring != -1;
+}
+
+bool UringSwapFile::registerBuffer(void* addr, size_t bytes)
+{
+    if (ring == -1 || bufferCount == URING_MAX_BUFFERS)
+    {
+        return false;
+    }
+    //the table is replaced as a whole
+    if (bufferCount > 0)
+    {
+        syscall(__NR_io_uring_register, ring, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+    buffers[bufferCount].iov_base = addr;
+    buffers[bufferCount].iov_len = bytes;
+    if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, buffers, bufferCount + 1) == 0)
+    {
+        bufferCount++;
+        return true;
+    }
+    if (bufferCount > 0 && syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, buffers, bufferCount) != 0)
+    {
+        bufferCount = 0;
+    }
+    return false;
+}
+
+ssize_t UringSwapFile::swapFileRead(void* addr, off_t offset, size_t bytes)
+{
+    return pread(fd, addr, bytes, offset);
+}
+
+ssize_t UringSwapFile::swapFileWrite(void* addr, off_t offset, size_t bytes)
+{
+    return pwrite(fd, addr, bytes, offset);
+}
+
+ssize_t UringSwapFile::swapFilereserve(off_t offset, size_t bytes)
+{
+    return fallocate(fd, 0, offset, bytes) == -1 ? 0 : bytes;
+}
+
+ssize_t UringSwapFile::swapFilerelease(off_t offset, size_t bytes)
+{
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, bytes) == -1 ? 0 : bytes;
+}
+
+void UringSwapFile::queueRead(void* addr, off_t offset, size_t bytes)
+{
+    queue(false, addr, offset, bytes);
+}
+
+void UringSwapFile::queueWrite(void* addr, off_t offset, size_t bytes)
+{
+    queue(true, addr, offset, bytes);
+}
+
+//index of the registered buffer that holds the memory or -1
+int UringSwapFile::fixedBuffer(void* addr, size_t bytes)
+{
+    for (unsigned i = 0; i < bufferCount; i++)
+    {
+        char* start = (char*) buffers[i].iov_base;
+        if ((char*) addr >= start && (char*) addr + bytes <= start + buffers[i].iov_len)
+        {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+void UringSwapFile::queue(bool write, void* addr, off_t offset, size_t bytes)
+{
+    if (ring == -1)
+    {
+        addCompleted(write ? pwrite(fd, addr, bytes, offset) : pread(fd, addr, bytes, offset));
+        return;
+    }
+    //a full ring is handed to the kernel, the oldest requests have to complete first
+    if (queued + inFlight == entries)
+    {
+        submit();
+        while (inFlight == entries)
+        {
+            if (reap() == 0)
+            {
+                uringEnter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+            }
+        }
+    }
+
+    unsigned tail = *submissionTail;
+    unsigned index = tail & *submissionMask;
+    struct io_uring_sqe* submission = &submissions[index];
+    memset(submission, 0, sizeof(*submission));
+    int buffer = fixedBuffer(addr, bytes);
+    if (buffer >= 0)
+    {
+        submission->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        submission->buf_index = (unsigned short) buffer;
+    }
+    else
+    {
+        submission->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    submission->fd = fd;
+    submission->off = (unsigned long long) offset;
+    submission->addr = (unsigned long long) addr;
+    submission->len = (unsigned) bytes;
+    submissionArray[index] = index;
+    //the kernel reads the entry only after it sees the new tail
+    __atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+}
+
+void UringSwapFile::submit()
+{
+    while (ring != -1 && queued > 0)
+    {
+        int submitted = uringEnter(ring, queued, 0, 0);
+        if (submitted > 0)
+        {
+            queued -= submitted;
+            inFlight += submitted;
+        }
+        else if (submitted < 0 && (errno == EAGAIN || errno == EBUSY) && inFlight > 0)
+        {
+            //the kernel is short of resources until some requests completed
+            if (reap() == 0)
+            {
+                uringEnter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+            }
+        }
+        else if (submitted == 0 || (errno != EINTR && errno != EAGAIN))
+        {
+            cerr << "|###> Error: io_uring_enter failed with errno " << errno << endl;
+            exit(1);
+        }
+    }
+}
+
+//takes the completions the kernel posted, failed requests make complete() return -1
+unsigned UringSwapFile::reap()
+{
+    unsigned head = *completionHead;
+    unsigned tail = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE);
+    unsigned reaped = 0;
+    for (; head != tail; head++, reaped++)
+    {
+        addCompleted(completions[head & *completionMask].res);
+    }
+    __atomic_store_n(completionHead, head, __ATOMIC_RELEASE);
+    inFlight -= reaped;
+    return reaped;
+}
+
+ssize_t UringSwapFile::complete()
+{
+    submit();
+    unsigned spins = 0;
+    while (inFlight > 0)
+    {
+        //page cache hits complete within microseconds, a system call per request costs more
+        if (reap() == 0 && ++spins > URING_POLL_SPINS)
+        {
+            uringEnter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+    return RandomAccessFile::complete();
+}
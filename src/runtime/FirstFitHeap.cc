@@ -1,48 +1,79 @@
 #include "runtime/FirstFitHeap.h"
 #include <unistd.h>
+#include <climits>
+#include <algorithm>
+#include <ucontext.h>
 
 bool initialized = 0;
+//end of the memory handed out with sbrk before the heap was constructed
+static char* preHeapEnd = NULL;
 extern VirtualMem vMem;
-extern std::mutex myMutex;
+extern FaultLock myMutex;
 extern FirstFitHeap heap;
 
 
-void signalHandler(int sigNUmber, siginfo_t *info, void *ucontext)
+//bit 1 of the page fault error code of x86-64 is set for writes, other CPUs are not asked
+static fault_access faultAccess(void *ucontext)
 {
-    myMutex.lock();
+#if defined(__x86_64__)
+    return (((ucontext_t*) ucontext)->uc_mcontext.gregs[REG_ERR] & 2) ? ACCESS_WRITE : ACCESS_READ;
+#else
+    (void) ucontext;
+    return ACCESS_UNKNOWN;
+#endif
+}
 
+//faults on present pages are fixed in parallel, the others one after the other
+void signalHandler(int sigNUmber, siginfo_t *info, void *ucontext)
+{
 	if (info->si_code == SEGV_ACCERR)
     {   
-        vMem.fixPermissions(info->si_addr);
+        //the thread would wait for itself, exit() is no way out: the destructors take the lock
+        if (myMutex.heldByCaller())
+        {
+            traceEvent(TRACE_NESTED_FAULT, info->si_addr);
+            traceDrain(STDERR_FILENO);
+            _exit(1);
+        }
+        myMutex.lock_shared();
+        bool fixed = vMem.fixPresentPage(info->si_addr, faultAccess(ucontext));
+        myMutex.unlock_shared();
+        if (!fixed)
+        {
+            myMutex.lock();
+            vMem.fixPermissions(info->si_addr);
+            myMutex.unlock();
+        }
     }
     else if (info->si_code == SEGV_MAPERR)
     {
-        cout << "|### Error: Access denied, unmapped @ address = " << info->si_addr << endl; 
+        traceEvent(TRACE_UNMAPPED_ACCESS, info->si_addr);
+        traceDrain(STDERR_FILENO);
         exit(1);
     }
-    
-   myMutex.unlock();
 }
 
 
 
-FirstFitHeap::FirstFitHeap() {
+FirstFitHeap::FirstFitHeap() : deferredFrees(NULL), deferFrees(false), maintenance(*this) {
     initialized = 1;
     this->head = (freeBlock*) (vMem.getStart());
 
     SigAction.sa_sigaction = signalHandler;
     SigAction.sa_flags = SA_SIGINFO;
     sigaction(SIGSEGV, &SigAction, NULL);
-    this->head->freeSpace = (unsigned) vMem.getSize();
-
-    std::thread timerThread(runLRUTimer);
-    timerThread.detach();
+    //the block sizes have 32 bits, of a larger memory the heap uses the first 4 GiB
+    size_t space = vMem.getSize();
+    size_t maxSpace = UINT_MAX / vMem.getPageSize() * vMem.getPageSize();
+    this->head->freeSpace = (unsigned) (space < maxSpace ? space : maxSpace);
 }
 
 
 
 FirstFitHeap::~FirstFitHeap(){
-    vMem.LRU_running = false;
+    stopMaintenance();
+    //diagnostics that were not drained by a TraceDrainer so far
+    traceDrain(STDERR_FILENO);
 }
 
 
@@ -50,14 +81,37 @@ FirstFitHeap::~FirstFitHeap(){
 void* FirstFitHeap::malloc(size_t size) {
     
     if(!initialized){
-        return sbrk(size);
+        //memory for the libc before the heap exists, pthread_create needs it aligned
+        uintptr_t brk = (uintptr_t) sbrk(0);
+        sbrk((-brk) & (alignof(max_align_t) - 1));
+        void* memory = sbrk((size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1));
+        preHeapEnd = (char*) sbrk(0);
+        return memory;
     }
     
     //user cannot allocate 0 byte
     if (size == 0) {
-        cerr << "Error: Please dont use a 0!" << endl;
+        traceEvent(TRACE_ZERO_ALLOC);
         return nullptr;
     }
+    if (size >= LARGE_BLOCK_THRESHOLD) {
+        return largeMalloc(size);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(heapMutex);
+    if (size <= SMALL_OBJECT_MAX) {
+        return smallMalloc(size);
+    }
+    void* block = firstFitMalloc(size);
+    //blocks waiting for the maintenance worker may be what's missing
+    if (block == nullptr && deferredFrees.load(std::memory_order_relaxed) != NULL) {
+        mergeDeferredFrees();
+        block = firstFitMalloc(size);
+    }
+    return block;
+}
+
+void* FirstFitHeap::firstFitMalloc(size_t size) {
     /////////////start normal method
     freeBlock* lastPos = 0;//Pointer to the free block before the right block
     freeBlock* curPos = this->head;//Pointer that points to a matching block
@@ -65,9 +119,9 @@ void* FirstFitHeap::malloc(size_t size) {
 
 
     //find free memory block with the needed size
-    while ((size_t) (curPos -> freeSpace) < size + 4 || curPos -> freeSpace < sizeof(freeBlock)) {
+    while ((size_t) (curPos -> freeSpace) < size + sizeHeader || curPos -> freeSpace < sizeof(freeBlock)) {
         if (curPos -> nextAddress == 0) {                
-            cerr << "Error: There is not enough memory available." << endl;
+            traceEvent(TRACE_OUT_OF_MEMORY, NULL, size);
             return nullptr;
         }
         lastPos = curPos;
@@ -99,9 +153,12 @@ void* FirstFitHeap::malloc(size_t size) {
 
     //record the size of the block
     *((unsigned*) curPos) = (unsigned) size;
+    if (HeapProfile::canaries) {
+        *(((unsigned*) curPos) + 1) = BLOCK_CANARY_USED;
+    }
 
     //Return the start of the usable block
-    return (void*) (((unsigned*) curPos) + 1);
+    return (void*) (((char*) curPos) + sizeHeader);
 }
 
 /*
@@ -112,9 +169,9 @@ the block will actually have because of the meta data of the FirstFitHeap
 */
 size_t FirstFitHeap::setRightSize(freeBlock* memBlock, size_t size) {
 
-    size_t rightSize = size + 4; //increase size, because each memory block given to the user stores an unsigned of meta data (its blocksize)
+    size_t rightSize = size + sizeHeader; //increase size, because each memory block given to the user stores its blocksize (and the canary) as meta data
 
-    if (size < sizeof(freeBlock)) {//if size is smaller than meata data freeFblock, size is set to size of meta data free block
+    if (rightSize < sizeof(freeBlock)) {//if size is smaller than meata data freeFblock, size is set to size of meta data free block
         rightSize = sizeof(freeBlock);
     }
 
@@ -157,12 +214,38 @@ void FirstFitHeap::fillList(list<int>* list) {
     }
 }
 
+int FirstFitHeap::getSize() {
+    return (int) vMem.getSize();
+}
+
+//blocks on the quick list of the maintenance worker are not counted until they are merged
+size_t FirstFitHeap::getFreeBytes() {
+    std::lock_guard<std::recursive_mutex> lock(heapMutex);
+    size_t freeBytes = 0;
+    for (freeBlock* block = head; block != NULL; block = block->nextAddress) {
+        freeBytes += block->freeSpace;
+    }
+    return freeBytes;
+}
+
+size_t FirstFitHeap::getLargestFreeBlock() {
+    std::lock_guard<std::recursive_mutex> lock(heapMutex);
+    size_t largest = 0;
+    for (freeBlock* block = head; block != NULL; block = block->nextAddress) {
+        if (block->freeSpace > largest) {
+            largest = block->freeSpace;
+        }
+    }
+    return largest;
+}
+
 void FirstFitHeap::merge(freeBlock* block1, freeBlock* block2) {
         block1->freeSpace = block1->freeSpace + (block2->freeSpace);
         block1->nextAddress = block2->nextAddress;
 }
 
-void FirstFitHeap::addBlockInList(freeBlock* block){
+//returns the free block the block is part of after merging
+freeBlock* FirstFitHeap::addBlockInList(freeBlock* block){
     freeBlock* pred = NULL;
     freeBlock* succ = this->head;
     while(succ < block && succ != NULL){
@@ -184,34 +267,151 @@ void FirstFitHeap::addBlockInList(freeBlock* block){
         pred->nextAddress = block;
         if((((char*)pred) + pred->freeSpace) == ((char*)block)){
             merge(pred, block);
+            return pred;
         }
     }
-    
+    return block;
 }
 
 void FirstFitHeap::free(void* address) {
 
-    if(address < vMem.getStart()){
-        //cerr << "Error: Address to free is smaller than start of the heap: " << address << endl;
+    Span* span = pageMap.get(address);
+    if (span != NULL) {
+        std::lock_guard<std::recursive_mutex> lock(heapMutex);
+        smallFree(span, address);
+        return;
+    }
+    if (isLargeBlock(address)) {
+        largeFree(address);
+        return;
+    }
+    //null and the memory of the libc from before the heap existed are no blocks, every profile needs this
+    if(address == NULL || (char*) address < preHeapEnd){
         return;
     }
-    if(address > (((char*) vMem.getStart()) + vMem.getSize())){
-        cerr << "Error: Address to free is bigger than end of the heap" << endl;
+    if(HeapProfile::boundsChecks && (address < vMem.getStart() || address > (((char*) vMem.getStart()) + vMem.getSize()))){
+        traceEvent(TRACE_FREE_OUT_OF_RANGE, address);
         return;
     }
-    unsigned* blockStart = ((unsigned*) address) - 1;
+    unsigned* blockStart = (unsigned*) (((char*) address) - sizeHeader);
 
-    
-    if(!correctAddress((void*) blockStart)){
-        cerr << "Error: Address in Heap can't be freed" << endl;
+    if(!checkBlock(blockStart, TRACE_FREE_NOT_A_BLOCK)){
         return;
     }
  
     unsigned int blockSize = *((unsigned*) blockStart);
     freeBlock* block = (freeBlock*) blockStart;
     block->freeSpace = blockSize;
+
+    //the canary lies in the padding of freeBlock, merging doesn't overwrite it
+    if (HeapProfile::canaries) {
+        *(blockStart + 1) = BLOCK_CANARY_FREE;
+    }
+
+    //with a maintenance worker the block only goes onto the quick list
+    if (deferFrees.load(std::memory_order_relaxed)) {
+        freeBlock* top = deferredFrees.load(std::memory_order_relaxed);
+        do {
+            block->nextAddress = top;
+        } while (!deferredFrees.compare_exchange_weak(top, block, std::memory_order_release, std::memory_order_relaxed));
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(heapMutex);
     addBlockInList(block); 
+}
 
+/*
+validates the block in front of a user pointer, depending on the build profile
+FAST does nothing, CHECKED compares the canary in O(1), AUDIT additionally walks the heap
+@param blockStart start of the block meta data
+@param error event that is traced if the block isn't a used block
+*/
+bool FirstFitHeap::checkBlock(unsigned* blockStart, trace_event error) {
+    if (HeapProfile::canaries) {
+        unsigned canary = *(blockStart + 1);
+        if (canary == BLOCK_CANARY_FREE) {
+            traceEvent(TRACE_DOUBLE_FREE, blockStart);
+            return false;
+        } else if (canary != BLOCK_CANARY_USED) {
+            traceEvent(TRACE_CANARY_CORRUPTED, blockStart, canary);
+            return false;
+        }
+    }
+
+    if (HeapProfile::heapWalk) {
+        std::lock_guard<std::recursive_mutex> lock(heapMutex);
+        if (!correctAddress((void*) blockStart)) {
+            traceEvent(error, blockStart);
+            return false;
+        }
+    }
+    return true;
+}
+
+void FirstFitHeap::startMaintenance(unsigned intervalMicros) {
+    maintenance.setInterval(intervalMicros);
+    if (!deferFrees.exchange(true)) {
+        maintenance.create();
+    }
+}
+
+void FirstFitHeap::stopMaintenance() {
+    if (deferFrees.exchange(false)) {
+        maintenance.stop();
+        maintain();
+    }
+}
+
+void FirstFitHeap::maintain() {
+    std::lock_guard<std::recursive_mutex> lock(heapMutex);
+    mergeDeferredFrees(true);
+
+    //give the memory of idle spans back to the first fit heap, keep one span per class
+    for (unsigned sizeClass = 0; sizeClass < SMALL_SIZE_CLASSES; sizeClass++) {
+        if (smallSpans[sizeClass] == NULL) {
+            continue;
+        }
+        Span* span = smallSpans[sizeClass]->next;
+        while (span != NULL) {
+            Span* next = span->next;
+            if (span->usedObjects == 0) {
+                releaseSpan(span);
+            }
+            span = next;
+        }
+    }
+}
+
+//has to be called with the heap lock held
+void FirstFitHeap::mergeDeferredFrees(bool discardPages) {
+    freeBlock* block = deferredFrees.exchange(NULL, std::memory_order_acquire);
+    while (block != NULL) {
+        freeBlock* next = block->nextAddress;
+        char* freed = (char*) block;
+        size_t freedBytes = block->freeSpace;
+        freeBlock* merged = addBlockInList(block);
+        if (discardPages && merged->freeSpace >= DISCARD_THRESHOLD) {
+            discardFreePages(merged, freed, freedBytes);
+        }
+        block = next;
+    }
+}
+
+/*
+gives the whole pages of a large free block back to the virtual memory, only those
+the freed range touches: the rest of the block was given back when it was freed.
+The header of the block stays.
+@param block free block that contains the freed range
+@param freed, freedBytes the block that was freed
+*/
+void FirstFitHeap::discardFreePages(freeBlock* block, char* freed, size_t freedBytes) {
+    uintptr_t pageSize = vMem.getPageSize();
+    uintptr_t start = std::max((uintptr_t) block + sizeof(freeBlock), (uintptr_t) freed / pageSize * pageSize);
+    uintptr_t end = std::min((uintptr_t) block + block->freeSpace, ((uintptr_t) freed + freedBytes + pageSize - 1) / pageSize * pageSize);
+    if (end > start) {
+        vMem.discard((void*) start, end - start);
+    }
 }
 
 //checks whether the address to free is a correct start of a block
@@ -234,7 +434,6 @@ bool FirstFitHeap::correctAddress(void* address){
             ptr1 += *((unsigned*) ptr1);
         }
     }
-    cerr << "address to free is not correct" << endl;
     return false;
 }
 
@@ -242,16 +441,35 @@ bool FirstFitHeap::correctAddress(void* address){
 
 void* FirstFitHeap::realloc(void* ptr, size_t size) {
     if (ptr == NULL) {
-        cout << "Error: cant realloc 0" << endl;
-        return malloc(size);
+        traceEvent(TRACE_REALLOC_NULL, NULL, size);
+        //not virtual, the libc calls this before the global heap is constructed
+        return FirstFitHeap::malloc(size);
     } else if (size == 0) {
-        free(ptr);
+        FirstFitHeap::free(ptr);
         return NULL;
-    } else if (correctAddress((void*) (( (unsigned*) ptr) - 1)) == false) {
-        cout << "ok why that ????? "<< endl;
+    }
+
+    Span* span = pageMap.get(ptr);
+    if (span != NULL) {
+        if (size <= span->sizeClass) {
+            return ptr;
+        }
+        void* returnPtr = malloc(size);
+        if (returnPtr == NULL) {
+            return NULL;
+        }
+        memcpy(returnPtr, ptr, span->sizeClass);
+        free(ptr);
+        return returnPtr;
+    }
+
+    if (isLargeBlock(ptr)) {
+        return largeRealloc(ptr, size);
+    } else if (!checkBlock((unsigned*) (((char*) ptr) - sizeHeader), TRACE_REALLOC_NOT_A_BLOCK)) {
         return NULL;
     }
-    unsigned malloc_size = *(( (unsigned*) ptr) - 1);
+    //usable size of the block, without the meta data
+    size_t malloc_size = *((unsigned*) (((char*) ptr) - sizeHeader)) - sizeHeader;
     void* returnPtr;
 
     if (malloc_size < size) {    
@@ -261,14 +479,7 @@ void* FirstFitHeap::realloc(void* ptr, size_t size) {
             return NULL;
         }
 
-        caddr_t oldPosPtr = (caddr_t) ptr;
-        caddr_t newPosPtr = (caddr_t) returnPtr;
-        for (size_t i = 0; i < size; i++) {
-            *(newPosPtr) = *(oldPosPtr);
-            newPosPtr++;
-            oldPosPtr++;
-        }
-
+        memcpy(returnPtr, ptr, malloc_size);
         free(ptr);
     } else {
         returnPtr = ptr;
@@ -278,26 +489,221 @@ void* FirstFitHeap::realloc(void* ptr, size_t size) {
 
 void* FirstFitHeap::calloc(size_t numEl, size_t size) {
     if (numEl == 0 || size == 0) {
-        cout << "Error: cant calloc 0" << endl;
+        traceEvent(TRACE_ZERO_CALLOC, NULL, numEl * size);
         return NULL;
     }
 
     size_t malloc_size = numEl * size;
-    void* returnPtr = malloc(malloc_size);
+    if (malloc_size / numEl != size) {
+        traceEvent(TRACE_OUT_OF_MEMORY, NULL, malloc_size);
+        return NULL;
+    }
+    //not virtual, the libc calls this before the global heap is constructed
+    void* returnPtr = FirstFitHeap::malloc(malloc_size);
     //if it is to big then return NULL
     if (returnPtr == NULL) {
         return NULL;
     }
 
-    caddr_t ptr = (caddr_t) returnPtr;
-    for (size_t i = 0; i < malloc_size; i++) {
-        *(ptr) = 0;
-        ptr++;
+    //fresh anonymous mappings are already zeroed by the kernel
+    if (malloc_size < LARGE_BLOCK_THRESHOLD) {
+        memset(returnPtr, 0, malloc_size);
     }
 
     return returnPtr ;
 }
 
+/*
+small objects have no header, they are cut out of page aligned spans of one size class
+and free() finds their span through the page map instead of reading memory next to them
+*/
+void* FirstFitHeap::smallMalloc(size_t size) {
+    unsigned sizeClass = (unsigned) ((size + SMALL_SIZE_CLASS_STEP - 1) / SMALL_SIZE_CLASS_STEP) - 1;
+    Span* span = smallSpans[sizeClass];
+    if (span == NULL) {
+        span = newSpan(sizeClass);
+        if (span == NULL) {
+            return firstFitMalloc(size);
+        }
+    }
+
+    void* object;
+    if (span->freeList != NULL) {
+        object = span->freeList;
+        span->freeList = *((void**) object);
+    } else {
+        object = span->unused;
+        span->unused += span->sizeClass;
+    }
+    span->usedObjects++;
+
+    //a full span leaves the list, it comes back with its next free object
+    if (span->freeList == NULL && span->unused + span->sizeClass > ((char*) span->start) + span->pages * PAGEMAP_PAGE_SIZE) {
+        smallSpans[sizeClass] = span->next;
+        if (span->next != NULL) {
+            span->next->prev = NULL;
+        }
+        span->next = span->prev = NULL;
+        span->listed = false;
+    }
+    return object;
+}
+
+void FirstFitHeap::smallFree(Span* span, void* ptr) {
+    if (HeapProfile::canaries && (((char*) ptr) - ((char*) span->start)) % span->sizeClass != 0) {
+        traceEvent(TRACE_FREE_NOT_A_BLOCK, ptr);
+        return;
+    }
+    if (HeapProfile::heapWalk) {
+        for (void* object = span->freeList; object != NULL; object = *((void**) object)) {
+            if (object == ptr) {
+                traceEvent(TRACE_DOUBLE_FREE, ptr);
+                return;
+            }
+        }
+    }
+
+    unsigned sizeClass = span->sizeClass / SMALL_SIZE_CLASS_STEP - 1;
+
+    *((void**) ptr) = span->freeList;
+    span->freeList = ptr;
+    span->usedObjects--;
+
+    if (!span->listed) {
+        span->next = smallSpans[sizeClass];
+        if (span->next != NULL) {
+            span->next->prev = span;
+        }
+        span->listed = true;
+        smallSpans[sizeClass] = span;
+    } else if (span->usedObjects == 0 && smallSpans[sizeClass] != span && !deferFrees.load(std::memory_order_relaxed)) {
+        //keep the first span of a class to avoid creating and releasing spans all the time,
+        //with a maintenance worker it releases the span later
+        releaseSpan(span);
+    }
+}
+
+Span* FirstFitHeap::newSpan(unsigned sizeClass) {
+    //one extra page to align the span, the page map works on whole pages
+    void* block = firstFitMalloc((SPAN_PAGES + 1) * PAGEMAP_PAGE_SIZE);
+    if (block == NULL) {
+        return NULL;
+    }
+    Span* span = (Span*) firstFitMalloc(sizeof(Span));
+    if (span == NULL) {
+        free(block);
+        return NULL;
+    }
+
+    span->block = block;
+    span->start = (void*) ((((size_t) block) + PAGEMAP_PAGE_SIZE - 1) & ~((size_t) PAGEMAP_PAGE_SIZE - 1));
+    span->pages = SPAN_PAGES;
+    span->sizeClass = (sizeClass + 1) * SMALL_SIZE_CLASS_STEP;
+    span->arena = this;
+    span->freeList = NULL;
+    span->unused = (char*) span->start;
+    span->usedObjects = 0;
+    span->listed = true;
+    span->prev = NULL;
+    span->next = smallSpans[sizeClass];
+    if (span->next != NULL) {
+        span->next->prev = span;
+    }
+
+    if (!pageMap.set(span->start, span->pages, span)) {
+        free(span);
+        free(block);
+        return NULL;
+    }
+    smallSpans[sizeClass] = span;
+    return span;
+}
+
+void FirstFitHeap::releaseSpan(Span* span) {
+    unsigned sizeClass = span->sizeClass / SMALL_SIZE_CLASS_STEP - 1;
+    if (span->prev != NULL) {
+        span->prev->next = span->next;
+    } else {
+        smallSpans[sizeClass] = span->next;
+    }
+    if (span->next != NULL) {
+        span->next->prev = span->prev;
+    }
+
+    pageMap.set(span->start, span->pages, NULL);
+    free(span->block);
+    free(span);
+}
+
+/*
+large blocks live in their own anonymous mapping with a largeBlock header in front,
+so growing them with realloc only changes page tables (mremap) and never copies the data
+*/
+void* FirstFitHeap::largeMalloc(size_t size) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t mappedSize = ((size + sizeof(largeBlock) + pageSize - 1) / pageSize) * pageSize;
+
+    void* mapping = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        traceEvent(TRACE_OUT_OF_MEMORY, NULL, size);
+        return nullptr;
+    }
+
+    largeBlock* block = (largeBlock*) mapping;
+    block->mappedSize = mappedSize;
+    block->magic = LARGE_BLOCK_MAGIC;
+    return (void*) (block + 1);
+}
+
+void* FirstFitHeap::largeRealloc(void* ptr, size_t size) {
+    largeBlock* block = ((largeBlock*) ptr) - 1;
+    size_t usableSize = block->mappedSize - sizeof(largeBlock);
+
+    //shrinking below the threshold moves the data back into the heap
+    if (size < LARGE_BLOCK_THRESHOLD) {
+        void* returnPtr = malloc(size);
+        if (returnPtr == NULL) {
+            return NULL;
+        }
+        memcpy(returnPtr, ptr, size < usableSize ? size : usableSize);
+        largeFree(ptr);
+        return returnPtr;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t mappedSize = ((size + sizeof(largeBlock) + pageSize - 1) / pageSize) * pageSize;
+    if (mappedSize == block->mappedSize) {
+        return ptr;
+    }
+
+    void* mapping = mremap(block, block->mappedSize, mappedSize, MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) {
+        traceEvent(TRACE_OUT_OF_MEMORY, NULL, size);
+        return NULL;
+    }
+
+    block = (largeBlock*) mapping;
+    block->mappedSize = mappedSize;
+    return (void*) (block + 1);
+}
+
+void FirstFitHeap::largeFree(void* ptr) {
+    largeBlock* block = ((largeBlock*) ptr) - 1;
+    block->magic = 0;
+    munmap(block, block->mappedSize);
+}
+
+//a large block starts right behind its header at the beginning of a page outside of the virtual memory
+bool FirstFitHeap::isLargeBlock(void* ptr) {
+    if (ptr == NULL || (((size_t) ptr) & (sysconf(_SC_PAGESIZE) - 1)) != sizeof(largeBlock)) {
+        return false;
+    }
+    if (ptr >= vMem.getStart() && ptr < (void*) (((char*) vMem.getStart()) + vMem.getSize())) {
+        return false;
+    }
+    return (((largeBlock*) ptr) - 1)->magic == LARGE_BLOCK_MAGIC;
+}
+
 void* FirstFitHeap::operator new(size_t size) {
     return heap.malloc(size);
 }
@@ -0,0 +1,27 @@
+#include "runtime/HeapMaintenance.h"
+#include "runtime/FirstFitHeap.h"
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+void HeapMaintenance::setInterval(unsigned intervalMicros)
+{
+	this->intervalMicros = intervalMicros;
+}
+
+void HeapMaintenance::stop()
+{
+	stopping = true;
+	join();
+	stopping = false;
+}
+
+void HeapMaintenance::run()
+{
+	//lowest priority for this thread only, SCHED_IDLE could starve it while it holds the heap lock
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+	while (!stopping) {
+		usleep(intervalMicros);
+		heap.maintain();
+	}
+}
@@ -1,33 +1,40 @@
 #include "runtime/Memalloc.h"
+#include "misc/TraceRing.h"
+#include "misc/AllocationTrace.h"
 
 
-VirtualMem vMem;
+VirtualMem vMem(VirtualMemConfig::fromEnvironment());
 FirstFitHeap heap;
-std::mutex myMutex;
+FaultLock myMutex;
+//records all calls if MEMALLOC_TRACE is set, defined after the heap so it is destroyed before it
+AllocationRecorder allocRecorder;
 
 
 void* operator new(size_t size) {
-    cout << "own new" << endl;
-
-    return heap.malloc(size);
-
+    traceEvent(TRACE_NEW, NULL, size);
 
+    void* ptr = heap.malloc(size);
+    allocRecorder.record(ALLOC_MALLOC, ptr, NULL, size);
+    return ptr;
 }
 
 void* operator new[](size_t size) {
 
-    return heap.malloc(size);
-
+    void* ptr = heap.malloc(size);
+    allocRecorder.record(ALLOC_MALLOC, ptr, NULL, size);
+    return ptr;
 }
 
 void operator delete(void* ptr) {
 
+    allocRecorder.record(ALLOC_FREE, NULL, ptr, 0);
     heap.free(ptr);
 
 }
 
 void operator delete[](void* ptr) {
 
+    allocRecorder.record(ALLOC_FREE, NULL, ptr, 0);
     heap.free(ptr);
 
 }
@@ -36,13 +43,17 @@ void operator delete[](void* ptr) {
 void* malloc(size_t size)
 {
     void* ptr = heap.malloc(size);
+    allocRecorder.record(ALLOC_MALLOC, ptr, NULL, size);
     return ptr;
 }
 
 void *realloc(void* ptr, size_t size){
-    cout << "own realloc" << endl;
+    traceEvent(TRACE_REALLOC, ptr, size);
 
+    //the id goes first, realloc may give the block back to the heap like free
+    uint32_t oldId = allocRecorder.detachRealloc(ptr);
     void *pointer =  heap.realloc(ptr, size);
+    allocRecorder.recordRealloc(pointer, ptr, oldId, size);
 
     return pointer;
 }
@@ -50,11 +61,13 @@ void *realloc(void* ptr, size_t size){
 void *calloc(size_t nmemb, size_t size){
 
     void *ptr = heap.calloc(nmemb, size);
+    allocRecorder.record(ALLOC_CALLOC, ptr, NULL, nmemb * size);
 
     return ptr;
 }
 
 void free(void* address) {
+    allocRecorder.record(ALLOC_FREE, NULL, address, 0);
     heap.free(address);
 
 }
@@ -0,0 +1,111 @@
+#include "runtime/MemoryResource.h"
+#include <new>
+#include <cstdint>
+#include <cstring>
+
+static char* alignUp(char* address, size_t alignment)
+{
+	return (char*) (((uintptr_t) address + alignment - 1) & ~((uintptr_t) alignment - 1));
+}
+
+void* heapAllocateAligned(Heap& heap, size_t bytes, size_t alignment, size_t heapAlignment)
+{
+	if (alignment <= heapAlignment) {
+		return heap.malloc(bytes);
+	}
+
+	char* raw = (char*) heap.malloc(bytes + alignment - 1 + sizeof(void*));
+	if (raw == NULL) {
+		return NULL;
+	}
+	char* aligned = alignUp(raw + sizeof(void*), alignment);
+	memcpy(aligned - sizeof(void*), &raw, sizeof(void*));
+	return aligned;
+}
+
+void heapFreeAligned(Heap& heap, void* ptr, size_t alignment, size_t heapAlignment)
+{
+	if (ptr == NULL || alignment <= heapAlignment) {
+		heap.free(ptr);
+		return;
+	}
+
+	void* raw;
+	memcpy(&raw, ((char*) ptr) - sizeof(void*), sizeof(void*));
+	heap.free(raw);
+}
+
+MonotonicResource::MonotonicResource(Memory& memory) : memory(memory)
+{
+	release();
+}
+
+void MonotonicResource::release()
+{
+	current = (char*) memory.getStart();
+	end = current + memory.getSize();
+	usedBytes = 0;
+}
+
+size_t MonotonicResource::getUsedBytes()
+{
+	return usedBytes;
+}
+
+void* MonotonicResource::do_allocate(size_t bytes, size_t alignment)
+{
+	char* ptr = alignUp(current, alignment);
+	if (current == NULL || ptr + bytes > end || ptr < current) {
+		//the rest of the current area is lost, the expansion may not follow it
+		void* area = memory.expand(bytes + alignment);
+		if (area == NULL || area == (void*) -1) {
+			throw std::bad_alloc();
+		}
+		current = (char*) area;
+		end = current + bytes + alignment;
+		ptr = alignUp(current, alignment);
+	}
+
+	current = ptr + bytes;
+	usedBytes += bytes;
+	return ptr;
+}
+
+void MonotonicResource::do_deallocate(void* ptr, size_t bytes, size_t alignment)
+{
+}
+
+bool MonotonicResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+	return this == &other;
+}
+
+HeapResource::HeapResource(Heap& heap, size_t heapAlignment) : heap(heap), heapAlignment(heapAlignment)
+{
+}
+
+Heap& HeapResource::getHeap()
+{
+	return heap;
+}
+
+void* HeapResource::do_allocate(size_t bytes, size_t alignment)
+{
+	//zero bytes are valid for a memory_resource, the heaps reject them
+	void* ptr = heapAllocateAligned(heap, bytes == 0 ? 1 : bytes, alignment, heapAlignment);
+	if (ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void HeapResource::do_deallocate(void* ptr, size_t bytes, size_t alignment)
+{
+	heapFreeAligned(heap, ptr, alignment, heapAlignment);
+}
+
+bool HeapResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+	const HeapResource* resource = dynamic_cast<const HeapResource*>(&other);
+	return resource != NULL && &resource->heap == &heap && resource->heapAlignment == heapAlignment;
+}
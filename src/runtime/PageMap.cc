@@ -0,0 +1,76 @@
+#include "runtime/PageMap.h"
+#include <sys/mman.h>
+#include <cstddef>
+
+//zeroed memory for a tree node, mmap because the page map is used inside of malloc
+static void* allocateNode(size_t size)
+{
+    void* node = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return node == MAP_FAILED ? NULL : node;
+}
+
+//installs a new node, if another thread was faster its node is used instead
+template <typename T>
+static T* installNode(std::atomic<T*>* slot)
+{
+    T* node = (T*) allocateNode(sizeof(T));
+    if (node == NULL) {
+        return NULL;
+    }
+
+    T* expected = NULL;
+    if (!slot->compare_exchange_strong(expected, node)) {
+        munmap(node, sizeof(T));
+        return expected;
+    }
+    return node;
+}
+
+PageMap::Leaf* PageMap::getLeaf(size_t pageNumber, bool create)
+{
+    size_t rootIndex = (pageNumber >> (2 * PAGEMAP_BITS)) & (PAGEMAP_NODE_SIZE - 1);
+    size_t nodeIndex = (pageNumber >> PAGEMAP_BITS) & (PAGEMAP_NODE_SIZE - 1);
+
+    Node* node = root[rootIndex].load(std::memory_order_acquire);
+    if (node == NULL) {
+        if (!create) {
+            return NULL;
+        }
+        node = installNode(&root[rootIndex]);
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+
+    Leaf* leaf = node->leaves[nodeIndex].load(std::memory_order_acquire);
+    if (leaf == NULL && create) {
+        leaf = installNode(&node->leaves[nodeIndex]);
+    }
+    return leaf;
+}
+
+Span* PageMap::get(const void* address)
+{
+    size_t pageNumber = ((size_t) address) >> PAGEMAP_PAGE_SHIFT;
+    Leaf* leaf = getLeaf(pageNumber, false);
+    if (leaf == NULL) {
+        return NULL;
+    }
+    return leaf->spans[pageNumber & (PAGEMAP_NODE_SIZE - 1)].load(std::memory_order_acquire);
+}
+
+bool PageMap::set(const void* start, size_t pages, Span* span)
+{
+    size_t pageNumber = ((size_t) start) >> PAGEMAP_PAGE_SHIFT;
+    for (size_t i = 0; i < pages; i++, pageNumber++) {
+        Leaf* leaf = getLeaf(pageNumber, span != NULL);
+        if (leaf == NULL) {
+            if (span != NULL) {
+                return false;
+            }
+            continue;
+        }
+        leaf->spans[pageNumber & (PAGEMAP_NODE_SIZE - 1)].store(span, std::memory_order_release);
+    }
+    return true;
+}
@@ -1,42 +1,117 @@
 #include "system/AddressMapping.h"
 
 
-unsigned AddressMapping::logAddr2PF(unsigned* virtualMemStart, unsigned* logAddr) {
-    //cout << "In logAddr2PF logAddr = " << logAddr << endl; 
-    unsigned phyAddr = ((char*) logAddr) - ((char*) virtualMemStart);
-    unsigned addrOfPT = *(virtualMemStart + phyAddr2PDIndex(phyAddr));
-    char* pageTableEntry = ((char*) virtualMemStart) + phyAddr2page(addrOfPT) + (phyAddr2PTIndex(phyAddr)*4);
-    //cout << "In logAddr2PF pageTableEntry = " << (void*) pageTableEntry << endl;
-    return *((unsigned*) pageTableEntry);
-}
-
-unsigned* AddressMapping::logAddr2PTEntryAddr(unsigned* virtualMemStart, unsigned* logAddr) {
-    unsigned phyAddr = ((size_t) logAddr) - ((size_t) virtualMemStart);
-    unsigned addrOfPT = *(virtualMemStart + phyAddr2PDIndex(phyAddr));
-    if (getPresentBit(addrOfPT) == NOT_PRESENT) {
+void AddressMapping::setLayout(char* tables, table_entry* tablePages, char* start) {
+    this->tables = tables;
+    this->tablePages = tablePages;
+    this->start = start;
+}
+
+size_t AddressMapping::tablesFor(size_t pages) {
+    size_t tables = 1;
+    for (unsigned level = 1; level < TABLE_LEVELS; level++) {
+        pages = (pages + TABLE_ENTRIES - 1) / TABLE_ENTRIES;
+        tables += pages;
+    }
+    return tables;
+}
+
+//the table an entry of a higher level points to
+table_entry* AddressMapping::tableOf(table_entry entry) {
+    return (table_entry*) (tables + ((size_t) cutOfOffset(entry) << PAGE_OFFSET_BITS));
+}
+
+table_entry AddressMapping::logAddr2PF(void* logAddr) {
+    return *logAddr2PTEntryAddr(logAddr);
+}
+
+//an evicted table is not mapped, it must not be read
+bool AddressMapping::isResident(table_entry entry) {
+    return getPresentBit(tablePages[cutOfOffset(entry)]) == PRESENT;
+}
+
+table_entry* AddressMapping::logAddr2PTEntryAddr(void* logAddr) {
+    //the pages of the table area have their own entries
+    if ((char*) logAddr < start) {
+        return tablePages + (((char*) logAddr - tables) >> PAGE_OFFSET_BITS);
+    }
+    size_t phyAddr = (char*) logAddr - start;
+    table_entry* table = (table_entry*) tables;
+    for (unsigned level = TABLE_LEVELS - 1; level > 0; level--) {
+        table_entry entry = table[phyAddr2TableIndex(phyAddr, level)];
+        if (getPresentBit(entry) == NOT_PRESENT || !isResident(entry)) {
+            return 0;
+        }
+        table = tableOf(entry);
+    }
+    return table + phyAddr2TableIndex(phyAddr, 0);
+}
+
+table_entry* AddressMapping::missingTableEntry(void* logAddr) {
+    if ((char*) logAddr < start) {
         return 0;
     }
-    char* pageTableEntry = ((char*) virtualMemStart) + phyAddr2page(addrOfPT) + (phyAddr2PTIndex(phyAddr)*4);
-    return (unsigned*) pageTableEntry;
+    size_t phyAddr = (char*) logAddr - start;
+    table_entry* table = (table_entry*) tables;
+    for (unsigned level = TABLE_LEVELS - 1; level > 0; level--) {
+        table_entry* entry = table + phyAddr2TableIndex(phyAddr, level);
+        if (getPresentBit(*entry) == NOT_PRESENT) {
+            return entry;
+        }
+        if (!isResident(*entry)) {
+            return 0;
+        }
+        table = tableOf(*entry);
+    }
+    return 0;
 }
 
-// 1111111111 1111111111 000000000000
-unsigned AddressMapping::phyAddr2page(unsigned logaddr) {
-    logaddr = logaddr >> 12;
-	return logaddr << 12;
+size_t AddressMapping::evictedTable(void* logAddr) {
+    if ((char*) logAddr < start) {
+        return 0;
+    }
+    size_t phyAddr = (char*) logAddr - start;
+    table_entry* table = (table_entry*) tables;
+    for (unsigned level = TABLE_LEVELS - 1; level > 0; level--) {
+        table_entry entry = table[phyAddr2TableIndex(phyAddr, level)];
+        if (getPresentBit(entry) == NOT_PRESENT) {
+            return 0;
+        }
+        if (!isResident(entry)) {
+            return cutOfOffset(entry);
+        }
+        table = tableOf(entry);
+    }
+    return 0;
+}
+
+size_t AddressMapping::pageTableOf(void* logAddr) {
+    size_t phyAddr = (char*) logAddr - start;
+    table_entry* table = (table_entry*) tables;
+    table_entry entry = 0;
+    for (unsigned level = TABLE_LEVELS - 1; level > 0; level--) {
+        entry = table[phyAddr2TableIndex(phyAddr, level)];
+        if (getPresentBit(entry) == NOT_PRESENT || !isResident(entry)) {
+            return 0;
+        }
+        table = tableOf(entry);
+    }
+    return cutOfOffset(entry);
 }
 
-unsigned AddressMapping::phyAddr2PDIndex(unsigned page) {
-	return page >> 22;
+// 111...111 000000000000
+size_t AddressMapping::phyAddr2page(size_t logaddr) {
+    logaddr = logaddr >> PAGE_OFFSET_BITS;
+	return logaddr << PAGE_OFFSET_BITS;
 }
 
-unsigned AddressMapping::phyAddr2PTIndex(unsigned page) {
-    page = page << 10;
-    return page >> 22;
+// level 3 | level 2 | level 1 | level 0 | offset
+unsigned AddressMapping::phyAddr2TableIndex(size_t logaddr, unsigned level) {
+    return (logaddr >> (PAGE_OFFSET_BITS + level * TABLE_INDEX_BITS)) & (TABLE_ENTRIES - 1);
 }
 
-unsigned AddressMapping::cutOfOffset(unsigned logaddr) {
-	return logaddr >> 12;
+unsigned AddressMapping::cutOfOffset(table_entry entry) {
+	return (unsigned) (entry >> PAGE_OFFSET_BITS);
 }
 
 /**
@@ -77,62 +152,89 @@ unsigned AddressMapping::createOffset(bool presentBit, bool read_writeBit, bool
 /**
  * @return 0 = not present, 1 = present
  */
-unsigned AddressMapping::getPresentBit(unsigned phyAddr) {
+unsigned AddressMapping::getPresentBit(table_entry phyAddr) {
     return phyAddr & 0b1;
 }
 
-void AddressMapping::setPresentBit(unsigned* tableEntry, bool presentBit) {
+void AddressMapping::setPresentBit(table_entry* tableEntry, bool presentBit) {
     if (presentBit == 1) {
         *(tableEntry) = *(tableEntry) | 0b1;
     } else {
-        *(tableEntry) = *(tableEntry) & 0xFFFFFFFE;
+        *(tableEntry) = *(tableEntry) & ~(table_entry) 0b1;
     }
 }
 
-unsigned AddressMapping::getReadAndWriteBit(unsigned phyAddr) {
+unsigned AddressMapping::getReadAndWriteBit(table_entry phyAddr) {
     return (phyAddr & 0b10) >> 1;
 }
 
-void AddressMapping::setReadAndWriteBit(unsigned* tableEntry, bool read_writeBit) {
+void AddressMapping::setReadAndWriteBit(table_entry* tableEntry, bool read_writeBit) {
     if (read_writeBit == 1) {
         *(tableEntry) = *(tableEntry) | 0b10;
     } else {
-        *(tableEntry) = *(tableEntry) & 0xFFFFFFFD;
+        *(tableEntry) = *(tableEntry) & ~(table_entry) 0b10;
     }
 }
 
-unsigned AddressMapping::getAccessed(unsigned phyAddr) {
+unsigned AddressMapping::getAccessed(table_entry phyAddr) {
     return (phyAddr & 0b100) >> 2;
 }
 
-void AddressMapping::setAccessed(unsigned* tableEntry, bool accessed) {
+void AddressMapping::setAccessed(table_entry* tableEntry, bool accessed) {
     if (accessed == 1) {
         *(tableEntry) = *(tableEntry) | 0b100;
     } else {
-        *(tableEntry) = *(tableEntry) & 0xFFFFFFFB;
+        *(tableEntry) = *(tableEntry) & ~(table_entry) 0b100;
     }
 }
 
-unsigned AddressMapping::getPinnedBit(unsigned phyAddr) {
+unsigned AddressMapping::getPinnedBit(table_entry phyAddr) {
     return (phyAddr & 0b1000) >> 3;
 }
 
-void AddressMapping::setPinnedBit(unsigned* tableEntry, bool pinnedBit) {
+void AddressMapping::setPinnedBit(table_entry* tableEntry, bool pinnedBit) {
     if(pinnedBit == 1) {
         *(tableEntry) = *(tableEntry) | 0b1000;
     } else {
-        *(tableEntry) = *(tableEntry) & 0xFFFFFFF7;
+        *(tableEntry) = *(tableEntry) & ~(table_entry) 0b1000;
     }
 }
 
-unsigned AddressMapping::getLruBit(unsigned phyAddr) {
+unsigned AddressMapping::getLruBit(table_entry phyAddr) {
     return (phyAddr & 0b10000) >> 4;
 }
 
-void AddressMapping::setLruBit(unsigned* tableEntry, bool lruBit) {
+void AddressMapping::setLruBit(table_entry* tableEntry, bool lruBit) {
     if(lruBit == 1) {
         *(tableEntry) = *(tableEntry) | 0b10000; 
     } else {
-        *(tableEntry) = *(tableEntry) & 0xFFFFFEF;
+        *(tableEntry) = *(tableEntry) & ~(table_entry) 0b10000;
+    }
+}
+
+/**
+ * @return 1 = the page was read ahead and is not used so far
+ */
+unsigned AddressMapping::getReadaheadBit(table_entry phyAddr) {
+    return (phyAddr & 0b100000) >> 5;
+}
+
+void AddressMapping::setReadaheadBit(table_entry* tableEntry, bool readaheadBit) {
+    if(readaheadBit == 1) {
+        *(tableEntry) = *(tableEntry) | 0b100000;
+    } else {
+        *(tableEntry) = *(tableEntry) & ~(table_entry) 0b100000;
+    }
+}
+
+unsigned AddressMapping::getSameFilledBit(table_entry phyAddr) {
+    return (phyAddr & 0b1000000) >> 6;
+}
+
+void AddressMapping::setSameFilledBit(table_entry* tableEntry, bool sameFilledBit) {
+    if(sameFilledBit == 1) {
+        *(tableEntry) = *(tableEntry) | 0b1000000;
+    } else {
+        *(tableEntry) = *(tableEntry) & ~(table_entry) 0b1000000;
     }
 }
\ No newline at end of file
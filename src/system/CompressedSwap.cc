@@ -0,0 +1,160 @@
+#include "system/CompressedSwap.h"
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <sys/mman.h>
+
+using namespace std;
+
+//a page has to shrink to 3/4 of its size, otherwise the pool would hardly hold more than the frames
+#define MAX_COMPRESSED(pageSize) ((pageSize) * 3 / 4)
+
+template <typename T>
+static T *mapArray(size_t elements, int flags)
+{
+	void *array = mmap(NULL, elements * sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+	return array == MAP_FAILED ? NULL : (T *)array;
+}
+
+bool CompressedSwap::create(size_t budget, size_t pageSize, size_t pages)
+{
+	//the offsets in the directory have 32 bits
+	if (budget > 0xFFFFFFFFul)
+	{
+		budget = 0xFFFFFFFFul & ~(size_t)(COMPRESSED_GRANULE - 1);
+	}
+	if (budget < pageSize)
+	{
+		return false;
+	}
+	this->budget = budget;
+	this->pageSize = pageSize;
+	this->pages = pages;
+	classes = MAX_COMPRESSED(pageSize) / COMPRESSED_GRANULE;
+
+	pool = mapArray<char>(budget, MAP_NORESERVE);
+	freeLists = mapArray<unsigned>(classes, 0);
+	directory = mapArray<CompressedPage>(pages, MAP_NORESERVE);
+	scratch = mapArray<char>(pageSize, 0);
+	if (pool == NULL || freeLists == NULL || directory == NULL || scratch == NULL)
+	{
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+void CompressedSwap::destroy()
+{
+	if (pool != NULL)
+		munmap(pool, budget);
+	if (freeLists != NULL)
+		munmap(freeLists, classes * sizeof(unsigned));
+	if (directory != NULL)
+		munmap(directory, pages * sizeof(CompressedPage));
+	if (scratch != NULL)
+		munmap(scratch, pageSize);
+	pool = scratch = NULL;
+	freeLists = NULL;
+	directory = NULL;
+	budget = 0;
+}
+
+bool CompressedSwap::isEnabled()
+{
+	return pool != NULL;
+}
+
+size_t CompressedSwap::sizeClass(size_t length)
+{
+	return (length + COMPRESSED_GRANULE - 1) / COMPRESSED_GRANULE - 1;
+}
+
+//an object of the size class from its free list or from the rest of the pool
+bool CompressedSwap::allocate(size_t length, unsigned *offset)
+{
+	size_t sizeClass = this->sizeClass(length);
+	if (freeLists[sizeClass] != 0)
+	{
+		*offset = freeLists[sizeClass] - 1;
+		memcpy(&freeLists[sizeClass], pool + *offset, sizeof(unsigned));
+		return true;
+	}
+	size_t bytes = (sizeClass + 1) * COMPRESSED_GRANULE;
+	if (poolUsed + bytes > budget)
+	{
+		return false;
+	}
+	*offset = (unsigned)poolUsed;
+	poolUsed += bytes;
+	return true;
+}
+
+void CompressedSwap::release(CompressedPage& entry)
+{
+	size_t sizeClass = this->sizeClass(entry.length);
+	memcpy(pool + entry.offset, &freeLists[sizeClass], sizeof(unsigned));
+	freeLists[sizeClass] = entry.offset + 1;
+	entry.length = 0;
+}
+
+bool CompressedSwap::store(size_t page, const char *content)
+{
+	if (pool == NULL || page >= pages)
+	{
+		return false;
+	}
+	drop(page);
+	size_t length = compressor.compress(content, pageSize, scratch, MAX_COMPRESSED(pageSize));
+	unsigned offset;
+	if (length == 0 || !allocate(length, &offset))
+	{
+		return false;
+	}
+	memcpy(pool + offset, scratch, length);
+	directory[page].offset = offset;
+	directory[page].length = (unsigned)length;
+	return true;
+}
+
+bool CompressedSwap::load(size_t page, char *content)
+{
+	if (!contains(page))
+	{
+		return false;
+	}
+	CompressedPage& entry = directory[page];
+	//the swap file may hold an older content, it must not be used instead
+	if (!compressor.decompress(pool + entry.offset, entry.length, content, pageSize))
+	{
+		cerr << "|###> Error: compressed page " << page << " is corrupt" << endl;
+		exit(1);
+	}
+	return true;
+}
+
+bool CompressedSwap::contains(size_t page)
+{
+	return pool != NULL && page < pages && directory[page].length != 0;
+}
+
+void CompressedSwap::drop(size_t page)
+{
+	if (contains(page))
+	{
+		release(directory[page]);
+	}
+}
+
+void CompressedSwap::reset()
+{
+	if (pool == NULL)
+	{
+		return;
+	}
+	//fresh anonymous memory is zero, the pool and the directory give their pages back
+	madvise(directory, pages * sizeof(CompressedPage), MADV_DONTNEED);
+	madvise(pool, budget, MADV_DONTNEED);
+	memset(freeLists, 0, classes * sizeof(unsigned));
+	poolUsed = 0;
+}
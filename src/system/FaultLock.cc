@@ -0,0 +1,34 @@
+#include "system/FaultLock.h"
+
+//the lock the calling thread holds shared, a thread never takes it shared twice
+static thread_local const FaultLock *sharedByCaller = NULL;
+
+void FaultLock::lock()
+{
+	pthread_rwlock_wrlock(&rwlock);
+	owner.store(pthread_self(), std::memory_order_relaxed);
+	owned.store(true, std::memory_order_release);
+}
+
+void FaultLock::unlock()
+{
+	owned.store(false, std::memory_order_relaxed);
+	pthread_rwlock_unlock(&rwlock);
+}
+
+void FaultLock::lock_shared()
+{
+	pthread_rwlock_rdlock(&rwlock);
+	sharedByCaller = this;
+}
+
+void FaultLock::unlock_shared()
+{
+	sharedByCaller = NULL;
+	pthread_rwlock_unlock(&rwlock);
+}
+
+bool FaultLock::heldByCaller()
+{
+	return sharedByCaller == this || (owned.load(std::memory_order_acquire) && pthread_equal(owner.load(std::memory_order_relaxed), pthread_self()));
+}
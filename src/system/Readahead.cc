@@ -0,0 +1,104 @@
+#include "system/Readahead.h"
+#include <algorithm>
+#include <cstdlib>
+
+Readahead::Readahead()
+{
+    reset();
+}
+
+void Readahead::reset()
+{
+    for (unsigned i = 0; i < READAHEAD_STREAMS; i++)
+    {
+        streams[i].used = false;
+    }
+    nextStream = 0;
+}
+
+unsigned Readahead::onMiss(long page, long *stride)
+{
+    //the fault continues a stream: all pages read ahead before were used
+    for (unsigned i = 0; i < READAHEAD_STREAMS; i++)
+    {
+        ReadaheadStream &stream = streams[i];
+        if (stream.used && stream.stride != 0 && page == stream.lastPage + stream.stride)
+        {
+            if (stream.issued)
+            {
+                stream.window = std::min(stream.window * 2, (unsigned)READAHEAD_MAX_WINDOW);
+            }
+            stream.issued = true;
+            stream.lastPage = page;
+            stream.region = page >> READAHEAD_REGION_SHIFT;
+            *stride = stream.stride;
+            return stream.window;
+        }
+    }
+
+    //a new stride in a known region, or a new region that replaces the oldest stream
+    ReadaheadStream *stream = NULL;
+    for (unsigned i = 0; i < READAHEAD_STREAMS; i++)
+    {
+        if (streams[i].used && streams[i].region == (size_t)(page >> READAHEAD_REGION_SHIFT))
+        {
+            stream = &streams[i];
+            break;
+        }
+    }
+    if (stream == NULL)
+    {
+        stream = &streams[nextStream];
+        nextStream = (nextStream + 1) % READAHEAD_STREAMS;
+        stream->used = true;
+        stream->stride = 0;
+    }
+    else
+    {
+        long delta = page - stream->lastPage;
+        stream->stride = (delta != 0 && labs(delta) <= READAHEAD_MAX_STRIDE) ? delta : 0;
+    }
+    stream->region = page >> READAHEAD_REGION_SHIFT;
+    stream->lastPage = page;
+    stream->window = READAHEAD_MIN_WINDOW;
+    stream->issued = false;
+    return 0;
+}
+
+ReadaheadStream *Readahead::predicting(long page)
+{
+    for (unsigned i = 0; i < READAHEAD_STREAMS; i++)
+    {
+        ReadaheadStream &stream = streams[i];
+        if (!stream.used || !stream.issued || stream.stride == 0)
+        {
+            continue;
+        }
+        long distance = page - stream.lastPage;
+        if (distance % stream.stride == 0 && distance / stream.stride > 0
+            && distance / stream.stride <= 2 * READAHEAD_MAX_WINDOW)
+        {
+            return &stream;
+        }
+    }
+    return NULL;
+}
+
+void Readahead::onHit(long page)
+{
+    ReadaheadStream *stream = predicting(page);
+    if (stream != NULL)
+    {
+        stream->lastPage = page;
+        stream->region = page >> READAHEAD_REGION_SHIFT;
+    }
+}
+
+void Readahead::onUnused(long page)
+{
+    ReadaheadStream *stream = predicting(page);
+    if (stream != NULL)
+    {
+        stream->window = std::max(stream->window / 2, (unsigned)READAHEAD_MIN_WINDOW);
+    }
+}
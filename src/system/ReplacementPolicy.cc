@@ -0,0 +1,393 @@
+#include "system/ReplacementPolicy.h"
+#include <new>
+#include <cstring>
+#include <algorithm>
+#include <sys/mman.h>
+
+//the policy is created before any heap exists, so it gets a mapping of its own
+template <class Policy>
+static ReplacementPolicy *mapPolicy()
+{
+	void *storage = mmap(NULL, sizeof(Policy), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (storage == MAP_FAILED)
+	{
+		return NULL;
+	}
+	return new (storage) Policy();
+}
+
+ReplacementPolicy *ReplacementPolicy::create(replacement_policy type, unsigned capacity, void *start, size_t pageSize, size_t pages)
+{
+	ReplacementPolicy *policy;
+	size_t size;
+	switch (type)
+	{
+	case REPLACE_FIFO:
+		policy = mapPolicy<FifoPolicy>();
+		size = sizeof(FifoPolicy);
+		break;
+	case REPLACE_LRU:
+		policy = mapPolicy<LruPolicy>();
+		size = sizeof(LruPolicy);
+		break;
+	case REPLACE_2Q:
+		policy = mapPolicy<TwoQueuePolicy>();
+		size = sizeof(TwoQueuePolicy);
+		break;
+	case REPLACE_ARC:
+		policy = mapPolicy<ArcPolicy>();
+		size = sizeof(ArcPolicy);
+		break;
+	default:
+		policy = mapPolicy<ClockPolicy>();
+		size = sizeof(ClockPolicy);
+		break;
+	}
+	if (policy == NULL)
+	{
+		return NULL;
+	}
+	policy->mappedSize = size;
+	policy->setCapacity(capacity);
+	if (!policy->links.create(start, pageSize, pages))
+	{
+		destroy(policy);
+		return NULL;
+	}
+	return policy;
+}
+
+void ReplacementPolicy::destroy(ReplacementPolicy *policy)
+{
+	if (policy == NULL)
+	{
+		return;
+	}
+	size_t size = policy->mappedSize;
+	policy->links.destroy();
+	policy->~ReplacementPolicy();
+	munmap(policy, size);
+}
+
+replacement_policy ReplacementPolicy::fromName(const char *name, replacement_policy defaultPolicy)
+{
+	if (name == NULL)
+	{
+		return defaultPolicy;
+	}
+	const char *names[] = {"fifo", "clock", "lru", "2q", "arc"};
+	for (int i = REPLACE_FIFO; i <= REPLACE_ARC; i++)
+	{
+		if (strcmp(name, names[i]) == 0)
+		{
+			return (replacement_policy)i;
+		}
+	}
+	return defaultPolicy;
+}
+
+void ReplacementPolicy::setCapacity(unsigned capacity)
+{
+	this->capacity = std::max(1u, capacity);
+}
+
+//the policies without ghosts only have to drop a resident page
+void ReplacementPolicy::onDiscard(void *page)
+{
+	onEvict(page);
+}
+
+/////////////////////////////////////////////////
+// FIFO
+
+void FifoPolicy::onFault(void *page)
+{
+	pages.enqueue(page);
+}
+
+void FifoPolicy::onAccess(void *page)
+{
+}
+
+void *FifoPolicy::chooseVictim(void *faultingPage)
+{
+	return pages.peek();
+}
+
+void FifoPolicy::onEvict(void *page)
+{
+	pages.remove(page);
+}
+
+void FifoPolicy::reset()
+{
+	pages.clear();
+}
+
+size_t FifoPolicy::getResidentCount()
+{
+	return pages.size();
+}
+
+/////////////////////////////////////////////////
+// CLOCK
+
+//a new page counts as referenced, it gets one round before it can be evicted
+void ClockPolicy::onFault(void *page)
+{
+	pages.enqueue(page);
+	links.setMarked(page, true);
+}
+
+void ClockPolicy::onAccess(void *page)
+{
+	if (pages.contains(page))
+	{
+		links.setMarked(page, true);
+	}
+}
+
+//the hand clears the reference of every page it passes, so it stops after one round at the latest
+void *ClockPolicy::chooseVictim(void *faultingPage)
+{
+	void *page;
+	while ((page = pages.peek()) != NULL && links.isMarked(page))
+	{
+		links.setMarked(page, false);
+		pages.moveToRear(page);
+	}
+	return page;
+}
+
+void ClockPolicy::onEvict(void *page)
+{
+	pages.remove(page);
+	links.setMarked(page, false);
+}
+
+void ClockPolicy::reset()
+{
+	pages.clear();
+}
+
+size_t ClockPolicy::getResidentCount()
+{
+	return pages.size();
+}
+
+/////////////////////////////////////////////////
+// LRU
+
+void LruPolicy::onFault(void *page)
+{
+	pages.enqueue(page);
+}
+
+void LruPolicy::onAccess(void *page)
+{
+	pages.moveToRear(page);
+}
+
+void *LruPolicy::chooseVictim(void *faultingPage)
+{
+	return pages.peek();
+}
+
+void LruPolicy::onEvict(void *page)
+{
+	pages.remove(page);
+}
+
+void LruPolicy::reset()
+{
+	pages.clear();
+}
+
+size_t LruPolicy::getResidentCount()
+{
+	return pages.size();
+}
+
+/////////////////////////////////////////////////
+// 2Q, the full version of Johnson & Shasha with Kin = 1/4 and Kout = 1/2 of the capacity
+
+unsigned TwoQueuePolicy::recentSize()
+{
+	return std::max(1u, capacity / 4);
+}
+
+unsigned TwoQueuePolicy::evictedSize()
+{
+	return std::max(1u, capacity / 2);
+}
+
+void TwoQueuePolicy::onFault(void *page)
+{
+	//evicted from recent and needed again: the page is hot
+	if (evicted.remove(page))
+	{
+		frequent.enqueue(page);
+	}
+	else
+	{
+		recent.enqueue(page);
+	}
+}
+
+//references while the page is in recent are correlated, they don't promote it
+void TwoQueuePolicy::onAccess(void *page)
+{
+	frequent.moveToRear(page);
+}
+
+void *TwoQueuePolicy::chooseVictim(void *faultingPage)
+{
+	if (recent.size() > recentSize() || frequent.checkEmpty())
+	{
+		return recent.peek();
+	}
+	return frequent.peek();
+}
+
+void TwoQueuePolicy::onEvict(void *page)
+{
+	if (recent.remove(page))
+	{
+		while (evicted.size() >= evictedSize())
+		{
+			evicted.dequeue();
+		}
+		evicted.enqueue(page);
+	}
+	else
+	{
+		frequent.remove(page);
+	}
+}
+
+void TwoQueuePolicy::onDiscard(void *page)
+{
+	if (!recent.remove(page) && !frequent.remove(page))
+	{
+		evicted.remove(page);
+	}
+}
+
+void TwoQueuePolicy::reset()
+{
+	recent.clear();
+	evicted.clear();
+	frequent.clear();
+}
+
+size_t TwoQueuePolicy::getResidentCount()
+{
+	return recent.size() + frequent.size();
+}
+
+/////////////////////////////////////////////////
+// ARC
+
+void ArcPolicy::onFault(void *page)
+{
+	size_t recentGhostCount = recentGhosts.size();
+	size_t frequentGhostCount = frequentGhosts.size();
+
+	//a hit in a ghost list shows which list was too small
+	if (recentGhosts.remove(page))
+	{
+		target = std::min(capacity, target + (unsigned)std::max((size_t)1, frequentGhostCount / recentGhostCount));
+		frequent.enqueue(page);
+	}
+	else if (frequentGhosts.remove(page))
+	{
+		unsigned delta = (unsigned)std::max((size_t)1, recentGhostCount / frequentGhostCount);
+		target = target > delta ? target - delta : 0;
+		frequent.enqueue(page);
+	}
+	else
+	{
+		recent.enqueue(page);
+	}
+	trimGhosts();
+}
+
+void ArcPolicy::onAccess(void *page)
+{
+	if (recent.remove(page))
+	{
+		frequent.enqueue(page);
+	}
+	else
+	{
+		frequent.moveToRear(page);
+	}
+}
+
+void *ArcPolicy::chooseVictim(void *faultingPage)
+{
+	size_t recentCount = recent.size();
+	bool frequentGhost = faultingPage != NULL && frequentGhosts.contains(faultingPage);
+
+	if (recentCount > 0 && (recentCount > target || (frequentGhost && recentCount == target) || frequent.checkEmpty()))
+	{
+		return recent.peek();
+	}
+	return frequent.peek();
+}
+
+void ArcPolicy::onEvict(void *page)
+{
+	if (recent.remove(page))
+	{
+		recentGhosts.enqueue(page);
+	}
+	else if (frequent.remove(page))
+	{
+		frequentGhosts.enqueue(page);
+	}
+	trimGhosts();
+}
+
+//|T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c
+void ArcPolicy::trimGhosts()
+{
+	while (!recentGhosts.checkEmpty() && recent.size() + recentGhosts.size() > capacity)
+	{
+		recentGhosts.dequeue();
+	}
+	while (!frequentGhosts.checkEmpty() && getResidentCount() + recentGhosts.size() + frequentGhosts.size() > 2 * capacity)
+	{
+		frequentGhosts.dequeue();
+	}
+}
+
+//the page tables take frames, p and the ghost lists shrink with the capacity
+void ArcPolicy::setCapacity(unsigned capacity)
+{
+	ReplacementPolicy::setCapacity(capacity);
+	target = std::min(target, this->capacity);
+	trimGhosts();
+}
+
+void ArcPolicy::onDiscard(void *page)
+{
+	if (!recent.remove(page) && !frequent.remove(page) && !recentGhosts.remove(page))
+	{
+		frequentGhosts.remove(page);
+	}
+}
+
+void ArcPolicy::reset()
+{
+	recent.clear();
+	frequent.clear();
+	recentGhosts.clear();
+	frequentGhosts.clear();
+	target = 0;
+}
+
+size_t ArcPolicy::getResidentCount()
+{
+	return recent.size() + frequent.size();
+}
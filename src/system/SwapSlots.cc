@@ -0,0 +1,130 @@
+#include "system/SwapSlots.h"
+#include <cstring>
+#include <sys/mman.h>
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+bool SwapSlots::create(size_t slots)
+{
+	this->slots = slots;
+	words = (slots + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	void *array = mmap(NULL, words * sizeof(unsigned long), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (array == MAP_FAILED)
+	{
+		bitmap = NULL;
+		return false;
+	}
+	bitmap = (unsigned long *)array;
+	reset();
+	return true;
+}
+
+void SwapSlots::destroy()
+{
+	if (bitmap != NULL)
+	{
+		munmap(bitmap, words * sizeof(unsigned long));
+	}
+	bitmap = NULL;
+}
+
+void SwapSlots::reset()
+{
+	if (bitmap == NULL)
+	{
+		return;
+	}
+	//fresh anonymous memory is zero, the bitmap gives its pages back
+	madvise(bitmap, words * sizeof(unsigned long), MADV_DONTNEED);
+	bitmap[0] = 1;
+	//the bits after the last slot are never free
+	if (slots % BITS_PER_WORD != 0)
+	{
+		bitmap[words - 1] |= ~0ul << (slots % BITS_PER_WORD);
+	}
+	//the first allocation looks for an empty cluster
+	cursor = slots;
+	emptyHint = 0;
+	used = 1;
+	top = 1;
+}
+
+unsigned SwapSlots::take(size_t slot)
+{
+	bitmap[slot / BITS_PER_WORD] |= 1ul << (slot % BITS_PER_WORD);
+	cursor = slot + 1;
+	used++;
+	if (slot / BITS_PER_WORD >= top)
+	{
+		top = slot / BITS_PER_WORD + 1;
+	}
+	return (unsigned)slot;
+}
+
+unsigned SwapSlots::allocate(bool *emptyCluster)
+{
+	unsigned slot = allocateSlot();
+	*emptyCluster = slot != SWAP_NO_SLOT && bitmap[slot / BITS_PER_WORD] == 1ul << (slot % BITS_PER_WORD);
+	return slot;
+}
+
+unsigned SwapSlots::allocateSlot()
+{
+	//the rest of the cluster of the last allocation
+	if (cursor < top * BITS_PER_WORD)
+	{
+		size_t word = cursor / BITS_PER_WORD;
+		unsigned long freeSlots = ~bitmap[word] & (~0ul << (cursor % BITS_PER_WORD));
+		if (freeSlots != 0)
+		{
+			return take(word * BITS_PER_WORD + __builtin_ctzl(freeSlots));
+		}
+	}
+
+	//the lowest empty cluster in the used part of the swap file
+	for (; emptyHint < top; emptyHint++)
+	{
+		if (bitmap[emptyHint] == 0)
+		{
+			emptyHint++;
+			return take((emptyHint - 1) * BITS_PER_WORD);
+		}
+	}
+
+	//the swap file only grows by a cluster if its used part is 3/4 full,
+	//otherwise the free slots between used ones are taken, from the cursor on
+	if (used < top * BITS_PER_WORD / 4 * 3 || top == words)
+	{
+		size_t start = cursor < top * BITS_PER_WORD ? cursor / BITS_PER_WORD : 0;
+		for (size_t i = 0; i < top; i++)
+		{
+			size_t word = (start + i) % top;
+			if (~bitmap[word] != 0)
+			{
+				return take(word * BITS_PER_WORD + __builtin_ctzl(~bitmap[word]));
+			}
+		}
+	}
+	if (top < words)
+	{
+		emptyHint = top + 1;
+		return take(top * BITS_PER_WORD);
+	}
+	return SWAP_NO_SLOT;
+}
+
+bool SwapSlots::release(unsigned slot)
+{
+	if (slot == SWAP_NO_SLOT || slot >= slots)
+	{
+		return false;
+	}
+	size_t word = slot / BITS_PER_WORD;
+	bitmap[word] &= ~(1ul << (slot % BITS_PER_WORD));
+	used--;
+	if (bitmap[word] == 0 && word < emptyHint)
+	{
+		emptyHint = word;
+	}
+	return bitmap[word] == 0;
+}
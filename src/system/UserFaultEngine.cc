@@ -0,0 +1,239 @@
+#include "system/UserFaultEngine.h"
+#include "system/VirtualMem.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+//messages read with one read() call
+#define USER_FAULT_BATCH 16
+#define USER_FAULT_STACK (512 * 1024)
+
+bool UserFaultEngine::start(void *start, size_t length, size_t pageSize, size_t bufferPages)
+{
+	this->pageSize = pageSize;
+	this->bufferPages = bufferPages;
+	uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (uffd == -1)
+	{
+		return false;
+	}
+
+	//write protection is optional, without it every page counts as dirty
+	struct uffdio_api api = {};
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+	if (ioctl(uffd, UFFDIO_API, &api) == -1)
+	{
+		close(uffd);
+		uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+		api.features = 0;
+		if (uffd == -1 || ioctl(uffd, UFFDIO_API, &api) == -1)
+		{
+			close(uffd);
+			uffd = -1;
+			return false;
+		}
+	}
+	writeProtection = (api.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP) != 0;
+
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	buffer = (char *)mmap(NULL, bufferPages * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	stack = (char *)mmap(NULL, USER_FAULT_STACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (wakeFd == -1 || buffer == MAP_FAILED || stack == MAP_FAILED || !registerRange(start, length))
+	{
+		close(uffd);
+		uffd = -1;
+		return false;
+	}
+
+	stopping = false;
+	started = true;
+	/*
+		The join in stop() must not fault: with a stack of the libc it frees the cached
+		stacks of other threads, whose TLS the libc allocated in the paged memory, and
+		no thread would resolve those faults any more.
+	*/
+	create(stack, USER_FAULT_STACK);
+	return true;
+}
+
+bool UserFaultEngine::registerRange(void *start, size_t length)
+{
+	struct uffdio_register reg = {};
+	reg.range.start = (unsigned long)start;
+	reg.range.len = length;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING | (writeProtection ? UFFDIO_REGISTER_MODE_WP : 0);
+	if (ioctl(uffd, UFFDIO_REGISTER, &reg) == -1)
+	{
+		return false;
+	}
+	if (writeProtection && !(reg.ioctls & ((__u64)1 << _UFFDIO_WRITEPROTECT)))
+	{
+		writeProtection = false;
+	}
+	return true;
+}
+
+void UserFaultEngine::stop()
+{
+	if (!started)
+	{
+		return;
+	}
+	stopping = true;
+	uint64_t one = 1;
+	if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+	{
+		cerr << "|###> Error: can't wake the userfault thread" << endl;
+	}
+	join();
+	started = false;
+	close(uffd);
+	close(wakeFd);
+	munmap(buffer, bufferPages * pageSize);
+	munmap(stack, USER_FAULT_STACK);
+	uffd = -1;
+}
+
+bool UserFaultEngine::isRunning()
+{
+	return started;
+}
+
+bool UserFaultEngine::tracksWrites()
+{
+	return writeProtection;
+}
+
+char *UserFaultEngine::getBuffer()
+{
+	return buffer;
+}
+
+void UserFaultEngine::copyPage(void *page, bool writeProtect)
+{
+	struct uffdio_copy copy = {};
+	copy.dst = (unsigned long)page;
+	copy.src = (unsigned long)buffer;
+	copy.len = pageSize;
+	copy.mode = (writeProtect && writeProtection) ? UFFDIO_COPY_MODE_WP : 0;
+	int result;
+	while ((result = ioctl(uffd, UFFDIO_COPY, &copy)) == -1 && errno == EAGAIN)
+	{
+		copy.copy = 0;
+	}
+	//EEXIST: the page is mapped already, the faulting threads only need the wake up
+	if (result == -1)
+	{
+		if (errno != EEXIST)
+		{
+			cerr << "|###> Error: UFFDIO_COPY failed at " << page << endl;
+		}
+		wake(page);
+	}
+}
+
+size_t UserFaultEngine::copyPages(void *start, char *source, size_t pages, bool writeProtect)
+{
+	struct uffdio_copy copy = {};
+	copy.dst = (unsigned long)start;
+	copy.src = (unsigned long)source;
+	copy.len = pages * pageSize;
+	copy.mode = (writeProtect && writeProtection) ? UFFDIO_COPY_MODE_WP : 0;
+	size_t copied = 0;
+	while (ioctl(uffd, UFFDIO_COPY, &copy) == -1)
+	{
+		//a partial copy reports the bytes it did, the rest is copied again
+		if (errno != EAGAIN || copy.copy <= 0)
+		{
+			return copied / pageSize;
+		}
+		copied += copy.copy;
+		copy.dst += copy.copy;
+		copy.src += copy.copy;
+		copy.len -= copy.copy;
+		copy.copy = 0;
+	}
+	return pages;
+}
+
+void UserFaultEngine::unprotect(void *page)
+{
+	if (!writeProtection)
+	{
+		wake(page);
+		return;
+	}
+	struct uffdio_writeprotect protect = {};
+	protect.range.start = (unsigned long)page;
+	protect.range.len = pageSize;
+	protect.mode = 0;
+	if (ioctl(uffd, UFFDIO_WRITEPROTECT, &protect) == -1)
+	{
+		wake(page);
+	}
+}
+
+bool UserFaultEngine::protect(void *page)
+{
+	if (!writeProtection)
+	{
+		return false;
+	}
+	struct uffdio_writeprotect protect = {};
+	protect.range.start = (unsigned long)page;
+	protect.range.len = pageSize;
+	protect.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+	return ioctl(uffd, UFFDIO_WRITEPROTECT, &protect) == 0;
+}
+
+void UserFaultEngine::dropPages(void *start, size_t pages)
+{
+	madvise(start, pages * pageSize, MADV_DONTNEED);
+	//the swap out made the pages read only
+	mprotect(start, pages * pageSize, PROT_READ | PROT_WRITE);
+}
+
+void UserFaultEngine::wake(void *page)
+{
+	struct uffdio_range range = {};
+	range.start = (unsigned long)page;
+	range.len = pageSize;
+	ioctl(uffd, UFFDIO_WAKE, &range);
+}
+
+void UserFaultEngine::run()
+{
+	struct uffd_msg messages[USER_FAULT_BATCH];
+	struct pollfd fds[2] = {{uffd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+
+	while (!stopping)
+	{
+		if (poll(fds, 2, -1) == -1)
+		{
+			continue;
+		}
+		ssize_t bytes = read(uffd, messages, sizeof(messages));
+		if (bytes <= 0)
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < bytes / sizeof(struct uffd_msg); i++)
+		{
+			if (messages[i].event != UFFD_EVENT_PAGEFAULT)
+			{
+				continue;
+			}
+			unsigned long long flags = messages[i].arg.pagefault.flags;
+			memory.userFault((void *)messages[i].arg.pagefault.address,
+				(flags & UFFD_PAGEFAULT_FLAG_WRITE) != 0, (flags & UFFD_PAGEFAULT_FLAG_WP) != 0);
+		}
+	}
+}
@@ -1,403 +1,1701 @@
 #include "system/VirtualMem.h"
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define PAGESIZE sysconf(_SC_PAGESIZE)
-#define FOUR_GB 4294967296
-#define PAGETABLE_SIZE 1024
-#define NUMBER_OF_PAGES FOUR_GB / PAGESIZE
-#define NUMBER_OF_PT NUMBER_OF_PAGES / PAGETABLE_SIZE
+//a readahead has at most one run per page
+#define SWAP_QUEUE_DEPTH READAHEAD_MAX_WINDOW
+//flags of an entry of /proc/self/pagemap
+#define PAGEMAP_PRESENT (1ull << 63)
+#define PAGEMAP_SWAPPED (1ull << 62)
+#define PAGEMAP_FILE (1ull << 61)
 
-extern std::mutex myMutex;
+extern FaultLock myMutex;
 
 
 
-VirtualMem::VirtualMem() {
-		this->numberOfPF = 10;
-		unsigned phyMemLength = PAGESIZE * numberOfPF;
-		//open the shared memory file (physical memory)
-		this->fd = shm_open("phy-Mem", O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+static unsigned long environmentValue(const char *name, unsigned long defaultValue)
+{
+	const char *value = getenv(name);
+	if (value == NULL || *value == '\0')
+	{
+		return defaultValue;
+	}
+	return strtoul(value, NULL, 0);
+}
+
+//true if the page repeats its first word, e.g. a page of zeros; 64 bytes are compared per step
+static bool sameFilledWord(const char *page, size_t size, unsigned long *word)
+{
+	unsigned long first;
+	memcpy(&first, page, sizeof(first));
+#ifdef __SSE2__
+	__m128i pattern = _mm_set1_epi64x((long long)first);
+	for (size_t i = 0; i < size; i += 64)
+	{
+		const __m128i *line = (const __m128i *)(page + i);
+		__m128i equal = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_load_si128(line), pattern), _mm_cmpeq_epi8(_mm_load_si128(line + 1), pattern)),
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_load_si128(line + 2), pattern), _mm_cmpeq_epi8(_mm_load_si128(line + 3), pattern)));
+		if (_mm_movemask_epi8(equal) != 0xFFFF)
+		{
+			return false;
+		}
+	}
+#else
+	const unsigned long *words = (const unsigned long *)page;
+	for (size_t i = 1; i < size / sizeof(unsigned long); i++)
+	{
+		if (words[i] != first)
+		{
+			return false;
+		}
+	}
+#endif
+	*word = first;
+	return true;
+}
+
+static void fillPage(char *page, size_t size, unsigned long word)
+{
+#ifdef __SSE2__
+	__m128i pattern = _mm_set1_epi64x((long long)word);
+	for (size_t i = 0; i < size; i += 16)
+	{
+		_mm_store_si128((__m128i *)(page + i), pattern);
+	}
+#else
+	unsigned long *words = (unsigned long *)page;
+	for (size_t i = 0; i < size / sizeof(unsigned long); i++)
+	{
+		words[i] = word;
+	}
+#endif
+}
+
+VirtualMemConfig VirtualMemConfig::fromEnvironment()
+{
+	VirtualMemConfig config;
+	config.frames = (unsigned) environmentValue("MEMALLOC_FRAMES", config.frames);
+	config.pageSize = environmentValue("MEMALLOC_PAGE_SIZE", config.pageSize);
+	config.writeBackAll = environmentValue("MEMALLOC_WRITE_BACK_ALL", config.writeBackAll) != 0;
+	const char *engine = getenv("MEMALLOC_ENGINE");
+	if (engine != NULL && strcmp(engine, "userfault") == 0)
+	{
+		config.engine = PAGING_USERFAULT;
+	}
+	config.replacement = ReplacementPolicy::fromName(getenv("MEMALLOC_REPLACEMENT"), config.replacement);
+	config.writeBackThreads = (unsigned) environmentValue("MEMALLOC_WRITE_BACK_THREADS", config.writeBackThreads);
+	config.compressedSwap = environmentValue("MEMALLOC_COMPRESSED_SWAP", config.compressedSwap);
+	config.swapExtent = environmentValue("MEMALLOC_SWAP_EXTENT", config.swapExtent);
+	config.virtualSize = environmentValue("MEMALLOC_VIRTUAL_SIZE", config.virtualSize);
+	const char *tracking = getenv("MEMALLOC_DIRTY_TRACKING");
+	if (tracking != NULL && strcmp(tracking, "pagemap") == 0)
+	{
+		config.dirtyTracking = DIRTY_PAGEMAP;
+	}
+	return config;
+}
+
+VirtualMem::VirtualMem(const VirtualMemConfig& config) {
+		//the tables split an address into 4 * 9 + 12 bits, they can't describe other pages
+		this->pageSize = PAGESIZE;
+		if (config.pageSize != 0 && config.pageSize != pageSize)
+		{
+			cerr << "|###> Error: the page tables only support pages of " << pageSize << " bytes" << endl;
+		}
+		if (pageSize != 1 << PAGE_OFFSET_BITS)
+		{
+			cerr << "|###> Error: the page tables need pages of " << (1 << PAGE_OFFSET_BITS) << " bytes, not " << pageSize << endl;
+			exit(1);
+		}
+		this->virtualSize = (config.virtualSize + pageSize - 1) / pageSize * pageSize;
+		if (virtualSize == 0 || virtualSize > MAX_VIRTUAL_SIZE)
+		{
+			cerr << "|###> Error: " << config.virtualSize << " bytes of virtual memory are not supported, using 4 GiB" << endl;
+			virtualSize = 1ull << 32;
+		}
+		this->writeBackAll = config.writeBackAll;
+		this->swapExtent = (config.swapExtent + pageSize - 1) / pageSize * pageSize;
+		this->numberOfPF = config.frames;
+		if (numberOfPF < MIN_FRAMES || numberOfPF > MAX_FRAMES)
+		{
+			cerr << "|###> Error: " << numberOfPF << " frames don't hold the page tables of a page and two data pages, using 10" << endl;
+			numberOfPF = 10;
+		}
+		off_t phyMemLength = (off_t)pageSize * numberOfPF;
+		//open the shared memory file (physical memory), one per process: the allocator
+		//is preloaded into every child of a traced program as well
+		char shmName[32];
+		snprintf(shmName, sizeof(shmName), "phy-Mem.%d", (int) getpid());
+		this->fd = shm_open(shmName, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
 		if (fd == -1)
 		{
 			cerr << "|###> Error: open the shm failed" << endl;
 			exit(1);
 		}
-		if (ftruncate(fd, phyMemLength) == -1)
+		//only the descriptor is used from now on
+		shm_unlink(shmName);
+		if (ftruncate(fd, phyMemLength) == -1)
+		{
+			cerr << "|###> Error: truncate failed" << endl;
+			exit(1);
+		}
+		//the frame tables are needed in the fault handler, so they don't come from the heap
+		this->freeFrames = (unsigned *)mmap(NULL, MAX_FRAMES * sizeof(unsigned), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->framePages = (void **)mmap(NULL, MAX_FRAMES * sizeof(void *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->frameSlots = (unsigned *)mmap(NULL, MAX_FRAMES * sizeof(unsigned), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->relocationBuffer = (char *)mmap(NULL, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		this->referencedPages = (void **)mmap(NULL, MAX_FRAMES * sizeof(void *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->evictedPages = (void **)mmap(NULL, MAX_FRAMES * sizeof(void *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (freeFrames == MAP_FAILED || framePages == MAP_FAILED || frameSlots == MAP_FAILED || relocationBuffer == MAP_FAILED || referencedPages == MAP_FAILED || evictedPages == MAP_FAILED)
+		{
+			cerr << "|###> Error: mmap of the frame tables failed" << endl;
+			exit(1);
+		}
+		//the table area holds all tables the data pages can need, it is only backed where tables are used
+		this->tableCount = AddressMapping::tablesFor(virtualSize / pageSize);
+		this->tablePages = (table_entry *)mmap(NULL, tableCount * sizeof(table_entry), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->tableParents = (unsigned *)mmap(NULL, tableCount * sizeof(unsigned), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->tableResidents = (unsigned short *)mmap(NULL, tableCount * sizeof(unsigned short), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->idleTables = (unsigned *)mmap(NULL, tableCount * sizeof(unsigned), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->idleQueued = (bool *)mmap(NULL, tableCount * sizeof(bool), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (tablePages == MAP_FAILED || tableParents == MAP_FAILED || tableResidents == MAP_FAILED || idleTables == MAP_FAILED || idleQueued == MAP_FAILED)
+		{
+			cerr << "|###> Error: mmap of the table entries failed" << endl;
+			exit(1);
+		}
+		/*map the whole logical memory size*/
+		this->virtualMemStartAddress = (char *)mmap(NULL, tableCount * pageSize + virtualSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (this->virtualMemStartAddress == (char *)MAP_FAILED)
+		{
+			cerr << "|###> Error: virtual Mmap Failed" << endl;
+			exit(1);
+		}
+		mappingUnit.setLayout(virtualMemStartAddress, tablePages, (char *)getStart());
+		//the root takes one frame
+		this->policy = ReplacementPolicy::create(config.replacement, numberOfPF - 1, getStart(), pageSize, getSize() / pageSize);
+		if (policy == NULL)
+		{
+			cerr << "|###> Error: mmap of the replacement policy failed" << endl;
+			exit(1);
+		}
+		this->fillWords = (unsigned long *)mmap(NULL, getSize() / pageSize * sizeof(unsigned long), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (fillWords == MAP_FAILED)
+		{
+			cerr << "|###> Error: mmap of the fill words failed" << endl;
+			exit(1);
+		}
+		//the slot of a page that is not present takes the place of its frame in the entry
+		if (!swapSlots.create(getSize() / pageSize + 1))
+		{
+			cerr << "|###> Error: mmap of the swap slots failed" << endl;
+			exit(1);
+		}
+		if (config.compressedSwap != 0 && !compressedSwap.create(config.compressedSwap, pageSize, getSize() / pageSize))
+		{
+			cerr << "|###> Warning: the compressed swap tier is not available, pages go to the swap file" << endl;
+		}
+
+		resetFrames();
+		initializeRootTable();
+
+		//the page tables stay with the signal engine, only the data pages are registered
+		if (config.engine == PAGING_USERFAULT)
+		{
+			//missing pages have to be accessible, otherwise the access raises SIGSEGV instead of a userfault
+			mprotect(getStart(), getSize(), PROT_READ | PROT_WRITE);
+			if (!userFaults.start(getStart(), getSize(), pageSize, READAHEAD_MAX_WINDOW))
+			{
+				cerr << "|###> Warning: userfaultfd is not available, using the signal engine" << endl;
+				mprotect(getStart(), getSize(), PROT_NONE);
+			}
+		}
+
+		//pages are loaded through a shared view of the frames, their private mappings show
+		//the content when it is complete, so no other thread sees a page half loaded
+		this->frameMemory = (char *)mmap(NULL, (size_t)MAX_FRAMES * pageSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+		if (frameMemory == MAP_FAILED)
+		{
+			frameMemory = NULL;
+		}
+
+		//the userfault engine sees the first write of a clean page without a second fault already
+		if (config.dirtyTracking == DIRTY_PAGEMAP && !userFaults.isRunning())
+		{
+			this->pagemapFd = open("/proc/self/pagemap", O_RDONLY);
+			if (frameMemory == NULL || pagemapFd == -1)
+			{
+				cerr << "|###> Warning: /proc/self/pagemap is not available, clean pages are read only" << endl;
+				if (pagemapFd != -1)
+					close(pagemapFd);
+				pagemapFd = -1;
+			}
+		}
+
+		//without io_uring the runs of a readahead are read one after the other
+		if (swapQueue.open(swapFile.fd, SWAP_QUEUE_DEPTH) && userFaults.isRunning())
+		{
+			swapQueue.registerBuffer(userFaults.getBuffer(), READAHEAD_MAX_WINDOW * pageSize);
+		}
+
+		//without write protection the userfault engine can't see a cleaned page getting dirty again
+		unsigned writeBackThreads = config.writeBackThreads;
+		if (userFaults.isRunning() && !userFaults.tracksWrites())
+		{
+			writeBackThreads = 0;
+		}
+		if (!writeBack.start(writeBackThreads, pageSize, swapFile.fd))
+		{
+			cerr << "|###> Warning: mmap of the write-back slots failed, dirty pages are written at eviction" << endl;
+		}
+}
+
+//all frames but the one of the root are free, the lowest ones are used first
+void VirtualMem::resetFrames()
+{
+	freeFrameCount = 0;
+	for (unsigned frame = numberOfPF - 1; frame >= 1; frame--)
+	{
+		framePages[frame] = NULL;
+		frameSlots[frame] = SWAP_NO_SLOT;
+		freeFrames[freeFrameCount++] = frame;
+	}
+	frameSlots[0] = SWAP_NO_SLOT;
+	framePages[0] = virtualMemStartAddress;
+}
+
+unsigned VirtualMem::allocFrame()
+{
+	if (freeFrameCount == 0)
+	{
+		cerr << "|###> Error: no free page frame" << endl;
+		exit(1);
+	}
+	return freeFrames[--freeFrameCount];
+}
+
+//writes the victim of the policy back (only if it is dirty, unless writeBackAll is set) and maps it out,
+//a table that maps no resident page is of no use until one of its pages is used again and goes first
+void VirtualMem::evictPage(void *faultingPage)
+{
+	if (evictIdleTable(faultingPage == NULL ? 0 : mappingUnit.pageTableOf(faultingPage)))
+	{
+		return;
+	}
+	void *kickedPageAddr = kickPageFromStack(faultingPage);
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(kickedPageAddr);
+
+	if (writeBackAll || isDirty(kickedPageAddr, pageTableEntry))
+	{
+		this->pageOut(kickedPageAddr);
+	}
+	mapOut(kickedPageAddr);
+	policy->onEvict(kickedPageAddr);
+}
+
+//evicts count pages like evictPage(), but maps out runs of adjacent victims with one call
+void VirtualMem::evictPages(size_t count)
+{
+	size_t evicted = 0;
+	for (; evicted < count; evicted++)
+	{
+		void *kickedPageAddr = kickPageFromStack(NULL);
+		table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(kickedPageAddr);
+		if (writeBackAll || isDirty(kickedPageAddr, pageTableEntry))
+		{
+			this->pageOut(kickedPageAddr);
+		}
+		policy->onEvict(kickedPageAddr);
+		evictedPages[evicted] = kickedPageAddr;
+	}
+
+	std::sort(evictedPages, evictedPages + evicted);
+	size_t runStart = 0;
+	for (size_t i = 1; i <= evicted; i++)
+	{
+		if (i == evicted || (char *)evictedPages[i] != (char *)evictedPages[i - 1] + pageSize)
+		{
+			mapOut(evictedPages[runStart], i - runStart);
+			runStart = i;
+		}
+	}
+}
+
+/*
+	The pages with the LRU bit were not used since the last sampling, the policy
+	evicts them next. A dirty one is compressed into the compressed tier or copied
+	into a slot while it is read only and marked clean; the copy is taken under
+	the lock, so no write can get lost. With userfaults the page is write
+	protected first, its next write is reported again.
+	One call looks at each frame at most once and stops when the slots are in flight.
+*/
+size_t VirtualMem::cleanColdPages()
+{
+	myMutex.lock();
+	size_t cleaned = 0;
+	for (unsigned scanned = 0; scanned < numberOfPF && !writeBackAll; scanned++)
+	{
+		if (cleanCursor >= numberOfPF)
+		{
+			cleanCursor = 0;
+		}
+		char *page = (char *)framePages[cleanCursor++];
+		if (page == NULL || page < (char *)getStart())
+		{
+			continue;
+		}
+		table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+		if (mappingUnit.getLruBit(*pageTableEntry) != LRU || !isDirty(page, pageTableEntry))
+		{
+			continue;
+		}
+		if (userFaults.isRunning() && !userFaults.protect(page))
+		{
+			continue;
+		}
+		mprotect(page, pageSize, PROT_READ);
+		//a page that is same filled or goes to the compressed tier needs no slot
+		if (!storeWithoutIo(page, pageTableEntry))
+		{
+			unsigned *swapSlot = &frameSlots[mappingUnit.cutOfOffset(*pageTableEntry)];
+			if (*swapSlot == SWAP_NO_SLOT)
+			{
+				*swapSlot = allocateSlot();
+			}
+			char *slot = writeBack.claimSlot(slotOffset(*swapSlot));
+			if (slot == NULL)
+			{
+				//the page is the first one of the next call
+				releaseSlot(pageTableEntry);
+				mprotect(page, pageSize, PROT_NONE);
+				cleanCursor--;
+				break;
+			}
+			memcpy(slot, page, pageSize);
+		}
+		if (pagemapFd != -1)
+		{
+			//the content goes back to the frame, a fresh private mapping of it has no copy that was written
+			unsigned frame = mappingUnit.cutOfOffset(*pageTableEntry);
+			memcpy(frameMemory + (size_t)frame * pageSize, page, pageSize);
+			mmap(page, pageSize, PROT_NONE, MAP_PRIVATE | MAP_FIXED, this->fd, (off_t)frame * pageSize);
+		}
+		mprotect(page, pageSize, PROT_NONE);
+		mappingUnit.setReadAndWriteBit(pageTableEntry, READ);
+		cleaned++;
+	}
+	myMutex.unlock();
+	return cleaned;
+}
+
+/*
+	Readahead may only take frames of pages that are cold: the policy's victim must
+	not have been used since the last sampling, its LRU bit is still set then.
+	Hot pages stay, the readahead stops instead.
+*/
+bool VirtualMem::evictColdPage()
+{
+	void *victim = policy->chooseVictim(NULL);
+	if (victim == NULL)
+	{
+		return false;
+	}
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(victim);
+	if (mappingUnit.getLruBit(*pageTableEntry) != LRU)
+	{
+		return false;
+	}
+
+	detachPage(victim);
+	if (writeBackAll || isDirty(victim, pageTableEntry))
+	{
+		this->pageOut(victim);
+	}
+	mapOut(victim);
+	policy->onEvict(victim);
+	return true;
+}
+
+//the page stays accessible until the next eviction, further references until then are not seen
+void VirtualMem::referencePage(void *pageStartAddr)
+{
+	referencedPages[referencedCount++] = pageStartAddr;
+}
+
+/*
+	References are sampled lazily: a page the policy heard of is made PROT_NONE
+	and marked with the LRU bit only when a victim is needed. Its next access faults
+	once (LRU_CASE_READ/WRITE in fixPermissions) and is reported with onAccess().
+	The pages are sorted, so a run of adjacent pages costs one mprotect, and there is
+	no thread that protects all pages.
+*/
+void VirtualMem::protectReferencedPages()
+{
+	std::sort(referencedPages, referencedPages + referencedCount);
+	char *runStart = NULL;
+	char *runEnd = NULL;
+	for (unsigned i = 0; i < referencedCount; i++)
+	{
+		char *page = (char *)referencedPages[i];
+		table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+		if (pageTableEntry == 0 || mappingUnit.getPresentBit(*pageTableEntry) != PRESENT || mappingUnit.getLruBit(*pageTableEntry) == LRU)
+		{
+			continue;
+		}
+		mappingUnit.setLruBit(pageTableEntry, LRU);
+		if (page != runEnd)
+		{
+			if (runStart != NULL)
+			{
+				mprotect(runStart, runEnd - runStart, PROT_NONE);
+			}
+			runStart = page;
+		}
+		runEnd = page + pageSize;
+	}
+	if (runStart != NULL)
+	{
+		mprotect(runStart, runEnd - runStart, PROT_NONE);
+	}
+	referencedCount = 0;
+}
+
+//copies a resident page into another frame and keeps its protection
+void VirtualMem::relocatePage(unsigned fromFrame, unsigned toFrame)
+{
+	void *page = framePages[fromFrame];
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+
+	//with userfaults a data page isn't backed by its frame, only the entry changes
+	if (userFaults.isRunning() && page >= getStart())
+	{
+		*pageTableEntry = ((table_entry)toFrame << PAGE_OFFSET_BITS) | (*pageTableEntry & 0xFFF);
+		framePages[toFrame] = page;
+		framePages[fromFrame] = NULL;
+		frameSlots[toFrame] = frameSlots[fromFrame];
+		frameSlots[fromFrame] = SWAP_NO_SLOT;
+		return;
+	}
+
+	//the new mapping forgets that the page was written
+	if (pagemapFd != -1 && page >= getStart())
+	{
+		isDirty(page, pageTableEntry);
+	}
+	int protection = PROT_READ;
+	if (mappingUnit.getLruBit(*pageTableEntry) == LRU)
+	{
+		protection = PROT_NONE;
+	}
+	else if (mappingUnit.getReadAndWriteBit(*pageTableEntry) == WRITE || pagemapFd != -1)
+	{
+		protection = PROT_READ | PROT_WRITE;
+	}
+
+	mprotect(page, pageSize, PROT_READ);
+	if (frameMemory != NULL)
+	{
+		memcpy(frameMemory + (size_t)toFrame * pageSize, page, pageSize);
+		if (mmap(page, pageSize, protection, MAP_PRIVATE | MAP_FIXED, this->fd, (off_t)toFrame * pageSize) == MAP_FAILED)
+		{
+			cerr << "|###> Error: phy Mmap Failed from " << page << endl;
+			exit(1);
+		}
+		*pageTableEntry = ((table_entry)toFrame << PAGE_OFFSET_BITS) | (*pageTableEntry & 0xFFF);
+		framePages[toFrame] = page;
+		framePages[fromFrame] = NULL;
+		frameSlots[toFrame] = frameSlots[fromFrame];
+		frameSlots[fromFrame] = SWAP_NO_SLOT;
+		return;
+	}
+	memcpy(relocationBuffer, page, pageSize);
+	if (mmap(page, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, this->fd, (off_t)toFrame * pageSize) == MAP_FAILED)
+	{
+		cerr << "|###> Error: phy Mmap Failed from " << page << endl;
+		exit(1);
+	}
+	memcpy(page, relocationBuffer, pageSize);
+	mprotect(page, pageSize, protection);
+
+	*pageTableEntry = ((table_entry)toFrame << PAGE_OFFSET_BITS) | (*pageTableEntry & 0xFFF);
+	framePages[toFrame] = page;
+	framePages[fromFrame] = NULL;
+	frameSlots[toFrame] = frameSlots[fromFrame];
+	frameSlots[fromFrame] = SWAP_NO_SLOT;
+}
+
+void VirtualMem::initializeVirtualMem(bool writeBackAll)
+{
+	myMutex.lock();
+	this->writeBackAll = writeBackAll;
+	policy->reset();
+	readahead.reset();
+	compressedSwap.reset();
+	swapSlots.reset();
+	referencedCount = 0;
+
+	//a fresh anonymous mapping replaces all pages and tables
+	if (mmap(virtualMemStartAddress, tableCount * pageSize + virtualSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+	{
+		cerr << "|###> Error: virtual Mmap Failed" << endl;
+		exit(1);
+	}
+	//no page of the old content may be written after the truncate
+	writeBack.waitAll();
+	if (ftruncate(swapFile.fd, 0) == -1)
+	{
+		cerr << "|###> Error: truncate of the swap file failed" << endl;
+	}
+	swapReserved = 0;
+	if (userFaults.isRunning() && (mprotect(getStart(), getSize(), PROT_READ | PROT_WRITE) == -1 || !userFaults.registerRange(getStart(), getSize())))
+	{
+		cerr << "|###> Error: userfaultfd registration failed" << endl;
+		exit(1);
+	}
+	pagesinRAM = 0;
+	pinnedPages = 0;
+	resetFrames();
+	initializeRootTable();
+	myMutex.unlock();
+}
+
+void VirtualMem::resetQueues()
+{
+	myMutex.lock();
+	evictPages(policy->getResidentCount());
+	myMutex.unlock();
+}
+
+bool VirtualMem::setFrameBudget(unsigned frames)
+{
+	myMutex.lock();
+	if (frames > MAX_FRAMES || frames < MIN_FRAMES)
+	{
+		cerr << "|###> Error: " << frames << " frames don't hold the page tables of a page and two data pages" << endl;
+		myMutex.unlock();
+		return false;
+	}
+
+	if (frames > numberOfPF)
+	{
+		if (ftruncate(fd, (off_t)frames * pageSize) == -1)
+		{
+			cerr << "|###> Error: truncate failed" << endl;
+			myMutex.unlock();
+			return false;
+		}
+		//the new frames are used before the old free ones
+		for (unsigned frame = frames - 1; frame >= numberOfPF; frame--)
+		{
+			framePages[frame] = NULL;
+			freeFrames[freeFrameCount++] = frame;
+		}
+	}
+	else if (frames < numberOfPF)
+	{
+		if (pagesinRAM > frames && policy->getResidentCount() > 0)
+		{
+			evictPages(std::min((size_t)(pagesinRAM - frames), policy->getResidentCount()));
+		}
+		//the tables left without resident pages go as well, until two frames stay for data pages
+		while (pagesinRAM > frames || pinnedPages + 2 > frames)
+		{
+			evictPage(NULL);
+		}
+
+		//only the frames below the new budget stay, the pages of the others move there
+		freeFrameCount = 0;
+		for (unsigned frame = frames - 1; frame >= 1; frame--)
+		{
+			if (framePages[frame] == NULL)
+			{
+				freeFrames[freeFrameCount++] = frame;
+			}
+		}
+		for (unsigned frame = frames; frame < numberOfPF; frame++)
+		{
+			if (framePages[frame] != NULL)
+			{
+				relocatePage(frame, allocFrame());
+			}
+		}
+		if (ftruncate(fd, (off_t)frames * pageSize) == -1)
+		{
+			cerr << "|###> Error: truncate failed" << endl;
+		}
+	}
+	numberOfPF = frames;
+	policy->setCapacity(frames - pinnedPages);
+	myMutex.unlock();
+	return true;
+}
+
+unsigned VirtualMem::getFrameBudget()
+{
+	return numberOfPF;
+}
+
+size_t VirtualMem::getPageSize()
+{
+	return pageSize;
+}
+
+bool VirtualMem::usesUserFaults()
+{
+	return userFaults.isRunning();
+}
+
+void VirtualMem::userFault(void *address, bool write, bool writeProtect)
+{
+	myMutex.lock();
+	void *pageStartAddr = findStartAddress(address);
+	table_entry *pagePTEntryAddr = mappingUnit.logAddr2PTEntryAddr(pageStartAddr);
+
+	if (writeProtect)
+	{
+		//first write to a clean page, from now on it is dirty
+		if (pagePTEntryAddr != 0 && mappingUnit.getPresentBit(*pagePTEntryAddr) == PRESENT)
+		{
+			markDirty(pageStartAddr, pagePTEntryAddr);
+		}
+		userFaults.unprotect(pageStartAddr);
+		myMutex.unlock();
+		return;
+	}
+
+	if (pagePTEntryAddr == 0)
+	{
+		addTables(pageStartAddr);
+		pagePTEntryAddr = mappingUnit.logAddr2PTEntryAddr(pageStartAddr);
+	}
+	table_entry pageFrameAddr = *pagePTEntryAddr;
+	//another thread faulted on the same page before
+	if (mappingUnit.getPresentBit(pageFrameAddr) == PRESENT)
+	{
+		userFaults.wake(pageStartAddr);
+		myMutex.unlock();
+		return;
+	}
+
+	if (pagesinRAM >= numberOfPF)
+	{
+		evictPage(pageStartAddr);
+	}
+	unsigned frame = allocFrame();
+	framePages[frame] = pageStartAddr;
+	pagesinRAM++;
+	addPageEntry2PT(pageStartAddr, frame);
+
+	bool dirty;
+	if (mappingUnit.getAccessed(pageFrameAddr) == ACCESSED)
+	{
+		if (!loadWithoutIo(pageStartAddr, pagePTEntryAddr, userFaults.getBuffer()))
+		{
+			off_t offset = slotOffset(pageSlot(pagePTEntryAddr));
+			writeBack.waitFor(offset, pageSize);
+			if (!swapFile.readFully(userFaults.getBuffer(), offset, pageSize))
+			{
+				swapFileFailed(pageStartAddr, pageSize);
+			}
+		}
+		dirty = write || !userFaults.tracksWrites();
+		userFaults.copyPage(pageStartAddr, !dirty);
+	}
+	else
+	{
+		//a new page is not on the swap file yet, so it is dirty. It is copied and not the
+		//shared zero page, only a copy can be write protected when it is cleaned
+		memset(userFaults.getBuffer(), 0, pageSize);
+		dirty = true;
+		userFaults.copyPage(pageStartAddr, false);
+	}
+
+	policy->onFault(pageStartAddr);
+	referencePage(pageStartAddr);
+	if (dirty)
+	{
+		markDirty(pageStartAddr, pagePTEntryAddr);
+	}
+	else
+	{
+		mappingUnit.setReadAndWriteBit(pagePTEntryAddr, READ);
+	}
+	mappingUnit.setPresentBit(pagePTEntryAddr, PRESENT);
+	readAhead(pageStartAddr);
+	myMutex.unlock();
+}
+
+/**
+ * This method is just called, when the whole virtual memory gets initialized.
+ * It maps the first page frame for the root table and pins it, the other tables
+ * are added when the first page they map is used.
+*/
+void VirtualMem::initializeRootTable()
+{
+	//fresh anonymous memory is zero, no page of the table area has an entry
+	madvise(tablePages, tableCount * sizeof(table_entry), MADV_DONTNEED);
+	madvise(tableResidents, tableCount * sizeof(unsigned short), MADV_DONTNEED);
+	madvise(idleQueued, tableCount * sizeof(bool), MADV_DONTNEED);
+	idleHead = 0;
+	idleCount = 0;
+
+	//map page frame for the root
+	if (mmap(virtualMemStartAddress, pageSize, PROT_WRITE | PROT_READ, MAP_PRIVATE | MAP_FIXED, this->fd, 0) == MAP_FAILED)
+	{
+		cerr << "|###> Error: Mmap of the root table Failed" << endl;
+		exit(1);
+	}
+	memset(virtualMemStartAddress, 0, pageSize);
+	pagesinRAM++;
+	pinnedPages++;
+	policy->setCapacity(numberOfPF - pinnedPages);
+	tablePages[0] = ((table_entry)0 << PAGE_OFFSET_BITS) | mappingUnit.createOffset(1, 1, 1, 1, 0);
+	usedTables = 1;
+}
+
+
+void VirtualMem::fixPermissions(void *address)
+{
+	/*
+		One part of fixPermissions is to translate the logical address, it is getting as the argument,
+		to the physical address the processor wants to read/write. To do this, we take the left most 9 of the 48 bits of the logical address for looking in the
+		root to find the beginning of the table of the next level, and so on with the next 9 bits for each of the 4 levels. The entry of the
+		last level is leading us to the beginning of the pageframe in phys. memory.
+		To find the right address in this page frame, we would have to take the last 12 bits of the log. address (=offset), and add them to the start
+		address of the pageframe. A real MMU would return to the processor this phys. address, so it knows where to read/write in phys. memory.
+		In our simulation this point wasn't needed, because the simulated phys. memory is directly mapped in the logical memory space. So
+		if you want to use this code as a blueprint for address translation in the real world, you will have to add the last 12 bits
+		to the entry of PT (of course without the status bits that are inside of it) and return the address to the processor. Otehrwise
+		the translation will not be completed and your program will crash.
+	*/
+	void *pageStartAddr = findStartAddress(address);
+	table_entry *pagePTEntryAddr = mappingUnit.logAddr2PTEntryAddr(pageStartAddr);
+	//if a table on the way is not present
+	if (pagePTEntryAddr == 0)
+	{
+		addTables(pageStartAddr);
+		pagePTEntryAddr = mappingUnit.logAddr2PTEntryAddr(pageStartAddr);
+	}
+	table_entry pageFrameAddr = mappingUnit.logAddr2PF(pageStartAddr);
+	permission_change permissionChange;
+
+	//the page was swapped out while this thread waited, the userfault engine maps it in again
+	if (userFaults.isRunning() && pageStartAddr >= getStart() && mappingUnit.getPresentBit(pageFrameAddr) == NOT_PRESENT)
+	{
+		return;
+	}
+	//determine which permission change is the right one
+	
+	if (mappingUnit.getPresentBit(pageFrameAddr) == NOT_PRESENT)
+	{
+		//this is the case when we change the permission from non to read
+		if (pagesinRAM < numberOfPF)
+		{
+			permissionChange = NONTOREAD_NOTFULL;
+		}
+		else
+		{
+			permissionChange = NONTOREAD_FULL;
+		}
+	}
+	else
+	{
+		if( mappingUnit.getLruBit(*pagePTEntryAddr) == 1 && mappingUnit.getReadAndWriteBit(*pagePTEntryAddr) == READ)
+		{
+			permissionChange = LRU_CASE_READ; 
+		}
+		else if( mappingUnit.getLruBit(*pagePTEntryAddr) == 1 && mappingUnit.getReadAndWriteBit(*pagePTEntryAddr) == WRITE)
+		{
+			permissionChange = LRU_CASE_WRITE;
+		}
+		else
+		{
+			permissionChange = READTOWRITE;
+		}
+	}
+
+	switch (permissionChange)
+	{
+	case NONTOREAD_NOTFULL:
+
+		//map the memory to the right location
+		mapIn(pageStartAddr);
+		//if there is already data on the disk, we have to this data in
+		if (mappingUnit.getAccessed(pageFrameAddr) == ACCESSED) this->pageIn(pageStartAddr);
+		else clearNewPage(pageStartAddr);
+		//setting all the bits and meta data
+		readPageActivate(pageStartAddr);
+		readAhead(pageStartAddr);
+		break;
+
+	case NONTOREAD_FULL:
+		{ 
+			//first we have to deactivate one page
+			evictPage(pageStartAddr);
+
+			///////////////////////////////////////////////////
+			//activate the page just like in case 1
+			mapIn(pageStartAddr);
+			if (mappingUnit.getAccessed(pageFrameAddr) == ACCESSED)	this->pageIn(pageStartAddr);
+			else clearNewPage(pageStartAddr);
+			readPageActivate(pageStartAddr);
+			readAhead(pageStartAddr);
+			break;
+		}
+	//referenced again after the page was protected for sampling
+	case LRU_CASE_READ:
+		{
+			//with userfaults the write protection tracks the dirty pages, with pagemap tracking the copies on write
+			mprotect(pageStartAddr, pageSize, userFaults.isRunning() || pagemapFd != -1 ? PROT_READ | PROT_WRITE : PROT_READ);
+			reportAccess(pageStartAddr, pagePTEntryAddr);
+			break; 
+		}	
+	case LRU_CASE_WRITE:
+		{
+			mprotect(pageStartAddr, pageSize, PROT_READ | PROT_WRITE);
+			reportAccess(pageStartAddr, pagePTEntryAddr);
+			break;  
+		}
+	
+	case READTOWRITE:
+		writePageActivate(pageStartAddr);
+		break;
+	}
+}
+
+/*
+	The faults that are left when a page is present only change its entry and
+	protection: the first access after the page was sampled and the first write
+	to a clean page. They run under the shared lock, nothing is mapped in or out
+	meanwhile. The stripe of the page orders the faults on it, the mprotect runs
+	outside of minorFaultMutex.
+*/
+//the page whose fault of unknown access was retried by this thread, a second fault on it is a write
+static thread_local void *retriedPage = NULL;
+
+bool VirtualMem::fixPresentPage(void *address, fault_access access)
+{
+	void *pageStartAddr = findStartAddress(address);
+	if (pageStartAddr < getStart() || pageStartAddr >= (char *)getStart() + getSize())
+	{
+		return false;
+	}
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(pageStartAddr);
+	if (pageTableEntry == 0)
+	{
+		return false;
+	}
+	std::lock_guard<std::mutex> pageLock(pageLocks[pageNumber(pageStartAddr) % PAGE_LOCK_STRIPES]);
+	if (mappingUnit.getPresentBit(*pageTableEntry) != PRESENT)
+	{
+		return false;
+	}
+
+	if (mappingUnit.getLruBit(*pageTableEntry) == LRU)
+	{
+		bool writable = mappingUnit.getReadAndWriteBit(*pageTableEntry) == WRITE || userFaults.isRunning() || pagemapFd != -1;
+		mprotect(pageStartAddr, pageSize, writable ? PROT_READ | PROT_WRITE : PROT_READ);
+		std::lock_guard<std::mutex> sharedState(minorFaultMutex);
+		reportAccess(pageStartAddr, pageTableEntry);
+	}
+	//the page is readable, another thread may have fixed it since this fault
+	else if (mappingUnit.getReadAndWriteBit(*pageTableEntry) == READ && access != ACCESS_READ)
+	{
+		if (access == ACCESS_UNKNOWN && retriedPage != pageStartAddr)
+		{
+			retriedPage = pageStartAddr;
+			return true;
+		}
+		retriedPage = NULL;
+		{
+			std::lock_guard<std::mutex> sharedState(minorFaultMutex);
+			markDirty(pageStartAddr, pageTableEntry);
+		}
+		mprotect(pageStartAddr, pageSize, PROT_READ | PROT_WRITE);
+	}
+	return true;
+}
+
+//sets all the meta data
+void* VirtualMem::kickPageFromStack(void *faultingPage) {
+
+	//the policy decides on the references up to now
+	protectReferencedPages();
+	void *kickedPageAddr = policy->chooseVictim(faultingPage);
+	if (kickedPageAddr == NULL)
+	{
+		cerr << "|###> Error: no data page to evict" << endl;
+		exit(1);
+	}
+
+	detachPage(kickedPageAddr);
+	return kickedPageAddr;
+}
+
+//decreases the number of active PF and marks the page not present
+void VirtualMem::detachPage(void *page)
+{
+	pagesinRAM--;
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+	if (mappingUnit.getReadaheadBit(*pageTableEntry) == READAHEAD)
+	{
+		readahead.onUnused(pageNumber(page));
+		mappingUnit.setReadaheadBit(pageTableEntry, NOT_READAHEAD);
+	}
+	mappingUnit.setLruBit(pageTableEntry, NO_LRU);
+	mappingUnit.setPresentBit(pageTableEntry, NOT_PRESENT);
+}
+
+//a sampled page was used again, the first use of a page read ahead is its fault
+void VirtualMem::reportAccess(void *pageStartAddr, table_entry *pageTableEntry)
+{
+	mappingUnit.setLruBit(pageTableEntry, NO_LRU);
+	if (mappingUnit.getReadaheadBit(*pageTableEntry) == READAHEAD)
+	{
+		mappingUnit.setReadaheadBit(pageTableEntry, NOT_READAHEAD);
+		readahead.onHit(pageNumber(pageStartAddr));
+	}
+	else
+	{
+		policy->onAccess(pageStartAddr);
+	}
+	referencePage(pageStartAddr);
+}
+
+/*
+	Called after a missing data page was mapped in. If the fault continues a
+	sequential or strided stream, the next pages of the stream that are on the swap
+	file are mapped in and read with one read per run of adjacent pages. They are
+	sampled right away (PROT_NONE and LRU bit), so their first use is seen, and
+	carry the readahead bit until then.
+*/
+void VirtualMem::readAhead(void *pageStartAddr)
+{
+	long stride;
+	unsigned window = readahead.onMiss(pageNumber(pageStartAddr), &stride);
+	char *pages[READAHEAD_MAX_WINDOW];
+	size_t count = 0;
+
+	for (unsigned i = 1; i <= window; i++)
+	{
+		char *page = (char *)pageStartAddr + i * stride * (long)pageSize;
+		if (page < (char *)getStart() || page >= (char *)getStart() + getSize())
+		{
+			break;
+		}
+		//only pages with content on the swap file, in a page table that exists
+		table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+		if (pageTableEntry == 0 || mappingUnit.getPresentBit(*pageTableEntry) == PRESENT || mappingUnit.getAccessed(*pageTableEntry) != ACCESSED)
+		{
+			continue;
+		}
+		if (pagesinRAM + count >= numberOfPF && !evictColdPage())
+		{
+			break;
+		}
+		pages[count++] = page;
+	}
+
+	//the reads of all runs of adjacent pages go to the kernel with one submission
+	std::sort(pages, pages + count);
+	size_t runStart = 0;
+	ssize_t queued = 0;
+	for (size_t i = 1; i <= count; i++)
+	{
+		if (i == count || pages[i] != pages[i - 1] + pageSize)
+		{
+			queued += queueReadAheadRun(pages[runStart], i - runStart, runStart);
+			runStart = i;
+		}
+	}
+	if (count == 0)
+	{
+		return;
+	}
+	//a failed or short read of the batch is done again page by page
+	if (swapQueue.complete() != queued)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(pages[i]);
+			unsigned slot = pageSlot(pageTableEntry);
+			char *content = userFaults.isRunning() ? userFaults.getBuffer() + i * pageSize : loadAddress(pages[i], pageTableEntry);
+			if (slot != SWAP_NO_SLOT && !swapFile.readFully(content, slotOffset(slot), pageSize))
+			{
+				swapFileFailed(pages[i], pageSize);
+			}
+		}
+	}
+
+	runStart = 0;
+	for (size_t i = 1; i <= count; i++)
+	{
+		if (i == count || pages[i] != pages[i - 1] + pageSize)
+		{
+			mapReadAheadRun(pages[runStart], i - runStart, runStart);
+			runStart = i;
+		}
+	}
+}
+
+/*
+	Prepares the pages of a run and queues its reads, with userfaults into the buffer
+	from bufferPage on. Pages in consecutive slots are read with one request, pages
+	without a slot are filled by mapReadAheadRun().
+	@return the bytes of the queued reads
+*/
+size_t VirtualMem::queueReadAheadRun(char *start, size_t pages, size_t bufferPage)
+{
+	size_t queued = 0;
+	if (!userFaults.isRunning())
+	{
+		mapIn(start, pages);
+		if (frameMemory == NULL)
+		{
+			mprotect(start, pages * pageSize, PROT_READ | PROT_WRITE);
+		}
+	}
+
+	//the frames of a run need not be consecutive
+	size_t slotRunStart = 0;
+	unsigned slotRunFirst = SWAP_NO_SLOT;
+	char *slotRunContent = NULL;
+	for (size_t i = 0; i <= pages; i++)
+	{
+		unsigned slot = SWAP_NO_SLOT;
+		char *content = NULL;
+		if (i < pages)
+		{
+			char *page = start + i * pageSize;
+			table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+			slot = pageSlot(pageTableEntry);
+			content = userFaults.isRunning() ? userFaults.getBuffer() + (bufferPage + i) * pageSize : loadAddress(page, pageTableEntry);
+		}
+		if (slotRunFirst != SWAP_NO_SLOT && slot == slotRunFirst + (i - slotRunStart) && content == slotRunContent + (i - slotRunStart) * pageSize)
 		{
-			cerr << "|###> Error: truncate failed" << endl;
-			exit(1);
+			continue;
 		}
-		/*map the whole logical memory size*/
-		this->virtualMemStartAddress = (unsigned *)mmap(NULL, FOUR_GB, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		if (this->virtualMemStartAddress == (unsigned *)MAP_FAILED)
+		if (slotRunFirst != SWAP_NO_SLOT)
 		{
-			cerr << "|###> Error: virtual Mmap Failed" << endl;
-			exit(1);
+			off_t offset = slotOffset(slotRunFirst);
+			writeBack.waitFor(offset, (i - slotRunStart) * pageSize);
+			swapQueue.queueRead(slotRunContent, offset, (i - slotRunStart) * pageSize);
+			queued += (i - slotRunStart) * pageSize;
 		}
-
-		initializePDandFirstPT();
+		slotRunStart = i;
+		slotRunFirst = slot;
+		slotRunContent = content;
+	}
+	return queued;
 }
 
-/**
- * This method is just called, when the whole virtual memory gets initialized.
- * It unmaps the first 2 pages of logical memory and maps 2 page frames of phys. memory,
- * to use. Furthermore it pins them.
-*/
-void VirtualMem::initializePDandFirstPT()
+//the read of the run completed, its pages are made resident and sampled
+void VirtualMem::mapReadAheadRun(char *start, size_t pages, size_t bufferPage)
 {
-	//unmap the first page, to map the same number of page frame for the PD
-	munmap(this->virtualMemStartAddress, PAGESIZE);
-
-	//map page frame for PD
-	unsigned *addrPD = (unsigned *)mmap(this->virtualMemStartAddress, PAGESIZE, PROT_WRITE | PROT_READ, MAP_PRIVATE | MAP_FIXED, this->fd, 0);
-	if (addrPD == (unsigned *)MAP_FAILED)
+	//the swap file has no or an older content of the same filled pages and the pages in the compressed tier
+	for (size_t i = 0; i < pages; i++)
 	{
-		cerr << "|###> Error: Mmap PD Failed" << endl;
-		exit(1);
+		char *page = start + i * pageSize;
+		table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+		loadWithoutIo(page, pageTableEntry, userFaults.isRunning() ? userFaults.getBuffer() + (bufferPage + i) * pageSize : loadAddress(page, pageTableEntry));
 	}
-	nextFreeFrameIndex++;
-	pagesinRAM++;
-	//initialize first PT with the two phys adresses of the PD and the PT itself
-	munmap(this->virtualMemStartAddress + PAGETABLE_SIZE, PAGESIZE);
 
-	//map page frame for PD
-	unsigned *addrFirstPT = (unsigned *)mmap(this->virtualMemStartAddress + PAGETABLE_SIZE, PAGESIZE, PROT_WRITE | PROT_READ, MAP_PRIVATE | MAP_FIXED, this->fd, PAGESIZE);
-	if (addrFirstPT == (unsigned *)MAP_FAILED)
+	bool dirty = false;
+	if (userFaults.isRunning())
 	{
-		cerr << "|###> Error: Mmap PD Failed" << endl;
-		exit(1);
+		//the pages exist once they are copied, pages that failed stay on the swap file
+		pages = userFaults.copyPages(start, userFaults.getBuffer() + bufferPage * pageSize, pages, true);
+		dirty = !userFaults.tracksWrites();
+		if (pages == 0)
+		{
+			return;
+		}
+		mapIn(start, pages);
 	}
-	nextFreeFrameIndex++;
-	pagesinRAM++;
-
-	*(virtualMemStartAddress + PAGETABLE_SIZE) = ((0 << 12) | mappingUnit.createOffset(1, 1, 1, 1, 0));
-	*(virtualMemStartAddress + PAGETABLE_SIZE + 1) = ((1 << 12) | mappingUnit.createOffset(1, 1, 1, 1, 0));
-
-	//add the physical address of the PT in the PD -> here the logical and physical value is equal to one another
-	*(virtualMemStartAddress) = (1 << 12) | mappingUnit.createOffset(1, 1, 1, 1, 0);
+	mprotect(start, pages * pageSize, PROT_NONE);
 
-	//create all PT but the presentBits are not set -> they are not mapped in
-	unsigned offset = mappingUnit.createOffset(0, 1, 0, 0, 0);
-	for (unsigned i = 1; i < PAGETABLE_SIZE; i++)
+	for (size_t i = 0; i < pages; i++)
 	{
-		//(i+1) because at 0 is PD and at 1 is first PT, so start the others PT starts at 2
-		*(virtualMemStartAddress + i) = (((i + 1) << 12) | offset);
+		char *page = start + i * pageSize;
+		table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+		if (dirty)
+		{
+			markDirty(page, pageTableEntry);
+		}
+		else
+		{
+			mappingUnit.setReadAndWriteBit(pageTableEntry, READ);
+		}
+		mappingUnit.setLruBit(pageTableEntry, LRU);
+		mappingUnit.setReadaheadBit(pageTableEntry, READAHEAD);
+		policy->onFault(page);
 	}
 }
 
-
-void runLRUTimer(){
-    vMem.LRU_running = true;
-    while(vMem.LRU_running){
-        std::this_thread::sleep_for(std::chrono::nanoseconds(10));
-        vMem.protNoneAll();
-    }
+long VirtualMem::pageNumber(void *page)
+{
+	return ((char *)page - (char *)getStart()) / (long)pageSize;
 }
 
-void VirtualMem::protNoneAll()
+//the slot of a present page is kept with its frame, the one of a missing page in its entry
+unsigned VirtualMem::pageSlot(table_entry *pageTableEntry)
 {
-	myMutex.lock();
-
-    if (this->accessQueue.checkEmpty())
-        return; 
-    else
-    {
-        for (int i = this->accessQueue.front; i != this->accessQueue.rear; i = (i + 1) % MAX_PAGES_IN_ACCESS_STACK)
-        {
-            
-			mprotect(this->accessQueue.accessedPages[i], PAGESIZE, PROT_NONE);
-			unsigned *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(this->virtualMemStartAddress, (unsigned*) this->accessQueue.accessedPages[i]);
-			mappingUnit.setLruBit(pageTableEntry, LRU);
-		}
-    }
-	myMutex.unlock();
+	unsigned slot = mappingUnit.cutOfOffset(*pageTableEntry);
+	return mappingUnit.getPresentBit(*pageTableEntry) == PRESENT ? frameSlots[slot] : slot;
 }
 
-void VirtualMem::fixPermissions(void *address)
+/*
+	The swap file is reserved with fallocate ahead of the slots, so a write in a fault
+	doesn't wait for the file system to allocate blocks and can't find the disk full.
+	A cluster that became empty was punched, it is reserved again when it is used.
+*/
+unsigned VirtualMem::allocateSlot()
 {
-	/*
-		One part of fixPermissions is to translate the logical address, it is getting as the argument,
-		to the physical address the processor wants to read/write. To do this, we take the left most 10 bits of the logical address for looking in the
-		PD to find the beginning of the PT. Once we found it, we use the next 10 bits of the logical address to
-		find the right entry in the PT. This entry is leading us to the beginning of the pageframe in phys. memory.
-		To find the right address in this page frame, we would have to take the last 12 bits of the log. address (=offset), and add them to the start
-		address of the pageframe. A real MMU would return to the processor this phys. address, so it knows where to read/write in phys. memory.
-		In our simulation this point wasn't needed, because the simulated phys. memory is directly mapped in the logical memory space. So
-		if you want to use this code as a blueprint for address translation in the real world, you will have to add the last 12 bits
-		to the entry of PT (of course without the status bits that are inside of it) and return the address to the processor. Otehrwise
-		the translation will not be completed and your program will crash.
-	*/
-	void *pageStartAddr = findStartAddress(address);
-	unsigned *pagePTEntryAddr = mappingUnit.logAddr2PTEntryAddr(virtualMemStartAddress, (unsigned *)pageStartAddr);
-	unsigned logAddrOf32Bits = ((char *)pageStartAddr) - ((char *)virtualMemStartAddress);
-	unsigned first10Bits = mappingUnit.phyAddr2PDIndex(logAddrOf32Bits);
-	//if PT not present
-	if (pagePTEntryAddr == 0)
+	bool emptyCluster;
+	unsigned slot = swapSlots.allocate(&emptyCluster);
+	if (slot == SWAP_NO_SLOT)
 	{
-		unsigned *addrPDEntry = virtualMemStartAddress + first10Bits;
-		addPTEntry2PD(addrPDEntry);
-		pagePTEntryAddr = mappingUnit.logAddr2PTEntryAddr(virtualMemStartAddress, (unsigned *)pageStartAddr);
+		cerr << "|###> Error: no free slot in the swap file" << endl;
+		exit(1);
 	}
-	unsigned pageFrameAddr = mappingUnit.logAddr2PF(virtualMemStartAddress, (unsigned *)pageStartAddr);
-	permission_change permissionChange;
-	//determine which permission change is the right one
-	
-	if (mappingUnit.getPresentBit(pageFrameAddr) == NOT_PRESENT)
+	if (swapExtent == 0)
 	{
-		//this is the case when we change the permission from non to read
-		if (pagesinRAM < numberOfPF)
-		{
-			permissionChange = NONTOREAD_NOTFULL;
-		}
-		else
-		{
-			permissionChange = NONTOREAD_FULL;
-		}
+		return slot;
 	}
-	else
+	off_t cluster = slotOffset(slot - slot % SWAP_CLUSTER_SLOTS);
+	if (emptyCluster && punchHoles && cluster < swapReserved)
 	{
-		if( mappingUnit.getLruBit(*pagePTEntryAddr) == 1 && mappingUnit.getReadAndWriteBit(*pagePTEntryAddr) == READ)
-		{
-			permissionChange = LRU_CASE_READ; 
-		}
-		else if( mappingUnit.getLruBit(*pagePTEntryAddr) == 1 && mappingUnit.getReadAndWriteBit(*pagePTEntryAddr) == WRITE)
-		{
-			permissionChange = LRU_CASE_WRITE;
-		}
-		else
+		swapFile.swapFilereserve(cluster, SWAP_CLUSTER_SLOTS * pageSize);
+	}
+	while (slotOffset(slot + 1) + (off_t)swapExtent / 2 > swapReserved)
+	{
+		//without support (or space) the blocks are allocated by the writes
+		if (swapFile.swapFilereserve(swapReserved, swapExtent) == 0)
 		{
-			permissionChange = READTOWRITE;
+			swapExtent = 0;
+			break;
 		}
+		swapReserved += swapExtent;
 	}
+	return slot;
+}
 
-	switch (permissionChange)
+//a written page of a private mapping of the frames is a copy, it is not in the file any more
+bool VirtualMem::pageWritten(void *page)
+{
+	uint64_t entry;
+	if (pread(pagemapFd, &entry, sizeof(entry), (off_t)((uintptr_t)page / pageSize * sizeof(entry))) != sizeof(entry))
 	{
-	case NONTOREAD_NOTFULL:
+		return true;
+	}
+	bool mapped = (entry & PAGEMAP_PRESENT) != 0 || (entry & PAGEMAP_SWAPPED) != 0;
+	return mapped && (entry & PAGEMAP_FILE) == 0;
+}
 
-		//map the memory to the right location
-		mapIn(pageStartAddr);
-		//if there is already data on the disk, we have to this data in
-		if (mappingUnit.getAccessed(pageFrameAddr) == ACCESSED) this->pageIn(pageStartAddr);
-		//setting all the bits and meta data
-		readPageActivate(pageStartAddr);
-		break;
+//with pagemap tracking a page that was written is only found out here, its copies are outdated then
+bool VirtualMem::isDirty(void *page, table_entry *pageTableEntry)
+{
+	if (mappingUnit.getReadAndWriteBit(*pageTableEntry) == WRITE)
+	{
+		return true;
+	}
+	if (pagemapFd == -1 || page < getStart() || !pageWritten(page))
+	{
+		return false;
+	}
+	markDirty(page, pageTableEntry);
+	return true;
+}
 
-	case NONTOREAD_FULL:
-		{ 
-			//first we have to deactivate one page
-			void *kickedPageAddr = kickPageFromStack();
-			unsigned physKickedPage = mappingUnit.logAddr2PF(virtualMemStartAddress, (unsigned*)kickedPageAddr);			
-			
-			// setting the pageout Pointer
-			this->pageoutPointer = mappingUnit.cutOfOffset(physKickedPage);
-			
-			if(mappingUnit.getReadAndWriteBit(physKickedPage) == WRITE){
-				this->pageOut(kickedPageAddr);
-			}
-			mapOut(kickedPageAddr);
+//the memory a present page is loaded into without writing to the page itself
+char *VirtualMem::loadAddress(void *page, table_entry *pageTableEntry)
+{
+	if (frameMemory == NULL)
+	{
+		return (char *)page;
+	}
+	return frameMemory + (size_t)mappingUnit.cutOfOffset(*pageTableEntry) * pageSize;
+}
 
-			///////////////////////////////////////////////////
-			//activate the page just like in case 1
-			mapIn(pageStartAddr);
-			if (mappingUnit.getAccessed(pageFrameAddr) == ACCESSED)	this->pageIn(pageStartAddr);
-			readPageActivate(pageStartAddr);
-			break;
-		}
-	case LRU_CASE_READ:
-		{
-			mprotect(pageStartAddr, PAGESIZE, PROT_READ);
-			this->accessQueue.putElementAtRear(pageStartAddr); 
-			mappingUnit.setLruBit(pagePTEntryAddr, false);
-			break; 
-		}	
-	case LRU_CASE_WRITE:
-		{
-			mprotect(pageStartAddr, PAGESIZE, PROT_WRITE);
-			this->accessQueue.putElementAtRear(pageStartAddr);
-			mappingUnit.setLruBit(pagePTEntryAddr, false);
-			break;  
-		}
-	
-	case READTOWRITE:
-		writePageActivate(pageStartAddr);
-		break;
+//a frame keeps the content of the last page loaded through the view
+void VirtualMem::clearNewPage(void *page)
+{
+	if (frameMemory != NULL)
+	{
+		memset(loadAddress(page, mappingUnit.logAddr2PTEntryAddr(page)), 0, pageSize);
 	}
 }
 
-//sets all the meta data
-void* VirtualMem::kickPageFromStack() {
+//the content of the present page on the swap file is not needed any more, nor are the blocks of an empty cluster
+void VirtualMem::releaseSlot(table_entry *pageTableEntry)
+{
+	unsigned frame = mappingUnit.cutOfOffset(*pageTableEntry);
+	unsigned slot = frameSlots[frame];
+	frameSlots[frame] = SWAP_NO_SLOT;
+	releaseSwapSlot(slot);
+}
 
-	//dequeue and decrease the number of active PF
-	void *kickedPageAddr = this->accessQueue.dequeue();
-	pagesinRAM--;
+void VirtualMem::releaseSwapSlot(unsigned slot)
+{
+	if (swapSlots.release(slot) && punchHoles)
+	{
+		punchHoles = swapFile.swapFilerelease(slotOffset(slot - slot % SWAP_CLUSTER_SLOTS), SWAP_CLUSTER_SLOTS * pageSize) != 0;
+	}
+}
 
-	unsigned *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(this->virtualMemStartAddress, (unsigned*) kickedPageAddr); 
-	mappingUnit.setLruBit(pageTableEntry, NO_LRU);
-	mappingUnit.setPresentBit(pageTableEntry, NOT_PRESENT);
-	return kickedPageAddr;
+off_t VirtualMem::slotOffset(unsigned slot)
+{
+	return (off_t)slot * pageSize;
+}
+
+//the copies of the page outside of RAM are outdated now
+void VirtualMem::markDirty(void *page, table_entry *pageTableEntry)
+{
+	mappingUnit.setReadAndWriteBit(pageTableEntry, WRITE);
+	mappingUnit.setSameFilledBit(pageTableEntry, NOT_SAME_FILLED);
+	compressedSwap.drop(pageNumber(page));
+	releaseSlot(pageTableEntry);
+}
+
+/*
+	A page that repeats one word, most often a page of zeros, is only marked in
+	its entry and its word is kept in fillWords. Other pages go to the compressed
+	tier if they fit, their slot is given back then. Page tables always go to the
+	swap file. The page has to be readable.
+	@return false if the page has to be written to the swap file
+*/
+bool VirtualMem::storeWithoutIo(void *page, table_entry *pageTableEntry)
+{
+	unsigned long word;
+	if (page >= getStart() && sameFilledWord((char *)page, pageSize, &word))
+	{
+		mappingUnit.setSameFilledBit(pageTableEntry, SAME_FILLED);
+		fillWords[pageNumber(page)] = word;
+		compressedSwap.drop(pageNumber(page));
+		releaseSlot(pageTableEntry);
+		return true;
+	}
+	mappingUnit.setSameFilledBit(pageTableEntry, NOT_SAME_FILLED);
+	if (compressedSwap.store(pageNumber(page), (char *)page))
+	{
+		releaseSlot(pageTableEntry);
+		return true;
+	}
+	return false;
+}
+
+//@return false if the content of the page has to be read from its slot
+bool VirtualMem::loadWithoutIo(void *page, table_entry *pageTableEntry, char *content)
+{
+	if (mappingUnit.getSameFilledBit(*pageTableEntry) == SAME_FILLED)
+	{
+		fillPage(content, pageSize, fillWords[pageNumber(page)]);
+		return true;
+	}
+	if (compressedSwap.load(pageNumber(page), content))
+	{
+		return true;
+	}
+	//the page was never written
+	if (pageSlot(pageTableEntry) == SWAP_NO_SLOT)
+	{
+		memset(content, 0, pageSize);
+		return true;
+	}
+	return false;
 }
 
 //sets all the meta data
 void VirtualMem::readPageActivate(void *pageStartAddr)
 {
-	//put in Queue and increase number of active PF
-	this->accessQueue.enqueue(pageStartAddr);
+	policy->onFault(pageStartAddr);
+	referencePage(pageStartAddr);
 
 	//setting the the bits in the tables
-	unsigned *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(virtualMemStartAddress, (unsigned *)pageStartAddr);
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(pageStartAddr);
 	mappingUnit.setReadAndWriteBit(pageTableEntry, READ);
 	mappingUnit.setPresentBit(pageTableEntry, PRESENT);
 
-	mprotect(pageStartAddr, PAGESIZE, PROT_READ);
+	mprotect(pageStartAddr, pageSize, pagemapFd != -1 ? PROT_READ | PROT_WRITE : PROT_READ);
 }
 
 //sets all the meta data
 void VirtualMem::writePageActivate(void *pageStartAddr)
 {
-	unsigned *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(virtualMemStartAddress, (unsigned *)pageStartAddr);
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(pageStartAddr);
 
-	mappingUnit.setReadAndWriteBit(pageTableEntry, WRITE);
-	mprotect(pageStartAddr, PAGESIZE, PROT_WRITE);
+	markDirty(pageStartAddr, pageTableEntry);
+	mprotect(pageStartAddr, pageSize, PROT_WRITE);
 }
 
 void VirtualMem::pageOut(void *kickedChunkAddr)
 {
-	off_t offset = reinterpret_cast<off_t>(kickedChunkAddr) - reinterpret_cast<off_t>(this->virtualMemStartAddress);
-	this->swapFile.swapFileWrite(kickedChunkAddr, offset, PAGESIZE);
+	//the page may be protected for sampling, write() can't read from it then
+	mprotect(kickedChunkAddr, pageSize, PROT_READ);
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(kickedChunkAddr);
+	if (storeWithoutIo(kickedChunkAddr, pageTableEntry))
+	{
+		return;
+	}
+	//a dirty page lost its slot, the pages evicted after each other get consecutive ones
+	unsigned *slot = &frameSlots[mappingUnit.cutOfOffset(*pageTableEntry)];
+	if (*slot == SWAP_NO_SLOT)
+	{
+		*slot = allocateSlot();
+	}
+	off_t offset = slotOffset(*slot);
+	//an older copy in flight must not overwrite this one
+	writeBack.waitFor(offset, pageSize);
+	if (!swapFile.writeFully(kickedChunkAddr, offset, pageSize))
+	{
+		swapFileFailed(kickedChunkAddr, pageSize);
+	}
+	//the fault had to wait for the write, the next victims are cleaned ahead
+	writeBack.wake();
 }
 
 void VirtualMem::pageIn(void *chunckStartAddr)
 {
-	off_t offset = reinterpret_cast<off_t>(chunckStartAddr) - reinterpret_cast<off_t>(this->virtualMemStartAddress);
-	this->swapFile.swapFileRead(chunckStartAddr, offset, PAGESIZE);
+	//without the view of the frames the page is loaded in place, freshly mapped pages are PROT_NONE
+	if (frameMemory == NULL)
+	{
+		mprotect(chunckStartAddr, pageSize, PROT_READ | PROT_WRITE);
+	}
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(chunckStartAddr);
+	char *content = loadAddress(chunckStartAddr, pageTableEntry);
+	if (loadWithoutIo(chunckStartAddr, pageTableEntry, content))
+	{
+		return;
+	}
+	off_t offset = slotOffset(pageSlot(pageTableEntry));
+	writeBack.waitFor(offset, pageSize);
+	if (!swapFile.readFully(content, offset, pageSize))
+	{
+		swapFileFailed(chunckStartAddr, pageSize);
+	}
 }
 
-void VirtualMem::mapOut(void *pageStartAddress)
+void VirtualMem::mapOut(void *pageStartAddress, size_t pages)
 {
-	//map out shared memory file
-	munmap(pageStartAddress, PAGESIZE);
-	//map in MAP_Anonymous (simulation for no physical nemory behind it)
-	mmap(pageStartAddress, PAGESIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
-	unsigned *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(virtualMemStartAddress, (unsigned *)pageStartAddress);
+	if (userFaults.isRunning() && pageStartAddress >= getStart())
+	{
+		userFaults.dropPages(pageStartAddress, pages);
+	}
+	else
+	{
+		//map in MAP_Anonymous over the shared memory file (simulation for no physical nemory behind it),
+		//MAP_FIXED replaces the old mapping without a moment in which the pages are unmapped
+		mmap(pageStartAddress, pages * pageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+	}
 
-	//TODO check if last Page (this only temporary solution)
-	unsigned dis = ((char *)pageTableEntry) - ((char *)virtualMemStartAddress);
-	if (dis < (PAGESIZE * 2) + 4)
+	for (size_t i = 0; i < pages; i++)
 	{
-		dis = dis - PAGESIZE - 4;
-		unsigned *pdEntry = (unsigned *)(((char *)virtualMemStartAddress) + dis);
-		mappingUnit.setPresentBit(pdEntry, NOT_PRESENT);
+		char *page = (char *)pageStartAddress + i * pageSize;
+		table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(page);
+		residentRemoved(parentTable(page));
+
+		//the frame is free again, the entry keeps the slot instead
+		unsigned frame = mappingUnit.cutOfOffset(*pageTableEntry);
+		framePages[frame] = NULL;
+		freeFrames[freeFrameCount++] = frame;
+		*pageTableEntry = ((table_entry)frameSlots[frame] << PAGE_OFFSET_BITS) | (*pageTableEntry & 0xFFF);
+		frameSlots[frame] = SWAP_NO_SLOT;
 	}
 }
 
-void VirtualMem::mapIn(void *pageStartAddress)
+void VirtualMem::mapIn(void *pageStartAddress, size_t pages)
 {
-	//unmap the virtual space
-	munmap(pageStartAddress, PAGESIZE);
+	//with userfaults a data page is filled by the engine, its frame is only bookkeeping
+	bool mapFrames = !(userFaults.isRunning() && pageStartAddress >= getStart());
+	size_t runStart = 0;
+	unsigned runFrame = 0;
 
-	//map in the physical space
-	void *addr;
-	if (pageoutPointer == 0)
-	{
-		addr = mmap(pageStartAddress, PAGESIZE, PROT_NONE, MAP_PRIVATE | MAP_FIXED, this->fd, nextFreeFrameIndex * PAGESIZE);
-		nextFreeFrameIndex++;
-	}
-	else
+	for (size_t i = 0; i <= pages; i++)
 	{
-		addr = mmap(pageStartAddress, PAGESIZE, PROT_NONE, MAP_PRIVATE | MAP_FIXED, this->fd, pageoutPointer * PAGESIZE);
+		unsigned frame = i < pages ? allocFrame() : 0;
+		//map in the physical space, MAP_FIXED replaces the anonymous pages
+		if (i > 0 && (i == pages || frame != runFrame + (i - runStart)))
+		{
+			char *runStartAddress = (char *)pageStartAddress + runStart * pageSize;
+			if (mapFrames && mmap(runStartAddress, (i - runStart) * pageSize, PROT_NONE, MAP_PRIVATE | MAP_FIXED, this->fd, (off_t)runFrame * pageSize) == MAP_FAILED)
+			{
+				cerr << "|###> Error: phy Mmap Failed from " << (void *)runStartAddress << endl;
+				exit(1);
+			}
+			runStart = i;
+		}
+		if (i == pages)
+		{
+			break;
+		}
+		if (runStart == i)
+		{
+			runFrame = frame;
+		}
+
+		void *page = (char *)pageStartAddress + i * pageSize;
+		framePages[frame] = page;
+		pagesinRAM++;
+		addPageEntry2PT(page, frame);
 	}
-	if (addr == MAP_FAILED)
+}
+
+void VirtualMem::addPageEntry2PT(void *startAddrPage, unsigned frame)
+{
+	//if a table on the way is not existing then create it
+	table_entry *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(startAddrPage);
+	if (pageTableEntry == 0)
 	{
-		cerr << "|###> Error: phy Mmap Failed from " << pageStartAddress << endl;
-		exit(1);
+		addTables(startAddrPage);
+		pageTableEntry = mappingUnit.logAddr2PTEntryAddr(startAddrPage);
 	}
-	pagesinRAM++;
 
-	addPageEntry2PT((unsigned *)pageStartAddress);
+	//a clean page that is same filled or in its slot needs no write when it is evicted again
+	unsigned sameFilled = mappingUnit.getSameFilledBit(*pageTableEntry);
+	frameSlots[frame] = mappingUnit.cutOfOffset(*pageTableEntry);
+	//the tables are pinned while they map resident pages
+	bool pinned = startAddrPage < getStart();
+	*(pageTableEntry) = ((table_entry)frame << PAGE_OFFSET_BITS) | mappingUnit.createOffset(1, 0, 1, pinned, 0);
+	mappingUnit.setSameFilledBit(pageTableEntry, sameFilled);
+	tableResidents[parentTable(startAddrPage)]++;
 }
 
-void VirtualMem::addPageEntry2PT(unsigned *startAddrPage)
+//loads the evicted and adds the missing tables on the way to the page, from the root down
+void VirtualMem::addTables(void *page)
 {
-	unsigned poutPtr = pageoutPointer;
-	unsigned nextFrame = nextFreeFrameIndex - 1;
+	for (;;)
+	{
+		size_t table = mappingUnit.evictedTable(page);
+		table_entry *entry = mappingUnit.missingTableEntry(page);
+		if (table != 0)
+		{
+			loadTable(table);
+		}
+		else if (entry != 0)
+		{
+			addTable(entry);
+		}
+		else
+		{
+			return;
+		}
+	}
+}
 
-	unsigned logAddrOf32Bits = ((char *)startAddrPage) - ((char *)virtualMemStartAddress);
-	unsigned first10Bits = mappingUnit.phyAddr2PDIndex(logAddrOf32Bits);
-	unsigned pageTableAddr = *(virtualMemStartAddress + first10Bits);
+//the table that holds the entry of a data page or of a table
+size_t VirtualMem::parentTable(void *page)
+{
+	if (page < getStart())
+	{
+		return tableParents[((char *)page - virtualMemStartAddress) / pageSize];
+	}
+	return mappingUnit.pageTableOf(page);
+}
 
-	//if the PT not existing then create it by setting the presentBit
-	if (mappingUnit.getPresentBit(pageTableAddr) == NOT_PRESENT)
+//a table that maps no resident page any more can be evicted, the root stays
+void VirtualMem::residentRemoved(size_t table)
+{
+	if (--tableResidents[table] == 0 && table != 0 && !idleQueued[table])
 	{
-		addPTEntry2PD(virtualMemStartAddress + first10Bits);
-		addPageEntry2PT((unsigned*) ((char*) virtualMemStartAddress) + mappingUnit.phyAddr2page(pageTableAddr));
+		idleQueued[table] = true;
+		idleTables[(idleHead + idleCount++) % tableCount] = (unsigned)table;
 	}
+}
 
-	//TODO check if last Page (this only temporary solution)
-	unsigned *pageTableEntry = mappingUnit.logAddr2PTEntryAddr(virtualMemStartAddress, (unsigned *)startAddrPage);
-	unsigned dis = ((char *)pageTableEntry) - ((char *)virtualMemStartAddress);
-	if (dis < (PAGESIZE * 2) + 4)
+/*
+	Writes the table that has been idle the longest to the swap file and frees its
+	frame. Tables that were used again since they were queued are dropped from the
+	queue, they are queued again when they become idle again. The table the entry
+	of a page is about to be written to is kept.
+	@return false if no table is idle
+*/
+bool VirtualMem::evictIdleTable(size_t keepTable)
+{
+	while (idleCount > 0)
 	{
-		//add the page in PT
-		if (poutPtr == 0)
+		size_t table = idleTables[idleHead];
+		idleHead = (idleHead + 1) % tableCount;
+		idleCount--;
+		idleQueued[table] = false;
+		table_entry *entry = &tablePages[table];
+		if (tableResidents[table] != 0 || mappingUnit.getPresentBit(*entry) != PRESENT || table == keepTable)
 		{
-			*(pageTableEntry) = (nextFrame << 12) | mappingUnit.createOffset(1, 0, 1, 1, 0);
+			continue;
 		}
-		else
+
+		char *page = virtualMemStartAddress + table * pageSize;
+		pagesinRAM--;
+		mappingUnit.setPresentBit(entry, NOT_PRESENT);
+		//the paging writes the tables itself, they are always dirty
+		pageOut(page);
+		mapOut(page);
+		pinnedPages--;
+		policy->setCapacity(numberOfPF - pinnedPages);
+		return true;
+	}
+	return false;
+}
+
+//reads an evicted table back, a page it maps is about to be used
+void VirtualMem::loadTable(size_t table)
+{
+	//the table that points to it stays
+	if (pagesinRAM >= numberOfPF && !evictIdleTable(tableParents[table]))
+	{
+		evictPage(NULL);
+	}
+
+	char *pageStartAddressOfTable = virtualMemStartAddress + table * pageSize;
+	mapIn(pageStartAddressOfTable);
+	pageIn(pageStartAddressOfTable);
+	pinnedPages++;
+	policy->setCapacity(numberOfPF - pinnedPages);
+	//its entries change right away, the copy on the swap file is outdated then
+	writePageActivate(pageStartAddressOfTable);
+	keepDataFrames();
+}
+
+void VirtualMem::addTable(table_entry *entry)
+{
+	if (usedTables >= tableCount)
+	{
+		cerr << "|###> Error: the table area is full" << endl;
+		exit(1);
+	}
+	size_t table = usedTables++;
+	char *pageStartAddressOfTable = virtualMemStartAddress + table * pageSize;
+	tableParents[table] = (unsigned)(((char *)entry - virtualMemStartAddress) / pageSize);
+
+	//if the RAM is full we need to throw something out, the table that gets the entry stays
+	if (pagesinRAM >= numberOfPF && !evictIdleTable(tableParents[table]))
+	{
+		evictPage(NULL);
+	}
+
+	mapIn(pageStartAddressOfTable);
+	clearNewPage(pageStartAddressOfTable);
+	pinnedPages++;
+	//the frame of the table is lost for the data pages the policy sizes its lists by
+	policy->setCapacity(numberOfPF - pinnedPages);
+
+	writePageActivate(pageStartAddressOfTable);
+
+	//the entry points to the page of the table in the table area
+	*entry = ((table_entry)table << PAGE_OFFSET_BITS) | mappingUnit.createOffset(1, 1, 1, 1, 0);
+	keepDataFrames();
+}
+
+/*
+	An instruction can use two data pages at once, if the tables leave only one frame
+	for them, it faults forever. Idle tables are evicted first, then data pages, until
+	their tables become idle. The new table and the tables on the way to it map a
+	resident page or aren't queued, so they stay.
+*/
+void VirtualMem::keepDataFrames()
+{
+	while (pinnedPages + 2 > numberOfPF && !evictIdleTable(0))
+	{
+		if (policy->getResidentCount() == 0)
 		{
-			*(pageTableEntry) = (poutPtr << 12) | mappingUnit.createOffset(1, 0, 1, 1, 0);
-			pageoutPointer = 0;
+			cerr << "|###> Error: " << pinnedPages << " page tables leave less than 2 of the " << numberOfPF << " frames for data pages" << endl;
+			exit(1);
 		}
+		evictPage(NULL);
 	}
-	else
+}
+
+/*
+	The content of freed pages is of no use, they are dropped instead of evicted:
+	nothing is written, the policy forgets them, and their slots, compressed copies
+	and fill words are released. Their entries are reset, so the next use finds a
+	new page. Adjacent resident pages are mapped out with one call. Evicted tables
+	are loaded, the pages they map may have slots; pages whose table is missing
+	were never used and are skipped with their table.
+*/
+void VirtualMem::discard(void *start, size_t bytes)
+{
+	char *page = (char *)(((uintptr_t)start + pageSize - 1) / pageSize * pageSize);
+	char *end = (char *)(((uintptr_t)start + bytes) / pageSize * pageSize);
+	char *runStart = NULL;
+	myMutex.lock();
+	while (page < end)
 	{
-		//add the page in PT
-		if (poutPtr == 0)
+		size_t table = mappingUnit.evictedTable(page);
+		table_entry *pageTableEntry = table == 0 ? mappingUnit.logAddr2PTEntryAddr(page) : 0;
+		bool present = pageTableEntry != 0 && mappingUnit.getPresentBit(*pageTableEntry) == PRESENT;
+		//the detached pages of the run still hold their frames, loading a table may need one
+		if (runStart != NULL && !present)
+		{
+			discardRun(runStart, (page - runStart) / pageSize);
+			runStart = NULL;
+		}
+		if (table != 0)
+		{
+			loadTable(table);
+			continue;
+		}
+		if (pageTableEntry == 0)
+		{
+			page = (char *)getStart() + (pageNumber(page) / TABLE_ENTRIES + 1) * TABLE_ENTRIES * pageSize;
+			continue;
+		}
+
+		compressedSwap.drop(pageNumber(page));
+		fillWords[pageNumber(page)] = 0;
+		policy->onDiscard(page);
+		if (present)
 		{
-			*(pageTableEntry) = (nextFrame << 12) | mappingUnit.createOffset(1, 0, 1, 0, 0);
+			releaseSlot(pageTableEntry);
+			detachPage(page);
+			if (runStart == NULL)
+			{
+				runStart = page;
+			}
 		}
 		else
 		{
-			*(pageTableEntry) = (poutPtr << 12) | mappingUnit.createOffset(1, 0, 1, 0, 0);
-			pageoutPointer = 0;
+			releaseSwapSlot(mappingUnit.cutOfOffset(*pageTableEntry));
+			*pageTableEntry = 0;
 		}
+		page += pageSize;
+	}
+	if (runStart != NULL)
+	{
+		discardRun(runStart, (page - runStart) / pageSize);
 	}
+	myMutex.unlock();
 }
 
-void VirtualMem::addPTEntry2PD(unsigned *pdEntryOfPT)
+//maps out detached pages, their entries are the ones of pages that were never used then
+void VirtualMem::discardRun(char *start, size_t pages)
 {
-	char *pageStartAddressOfPT = ((char *)virtualMemStartAddress) + mappingUnit.phyAddr2page(*(pdEntryOfPT));
-
-	//if the RAM is full we need to throw something out
-	if (pagesinRAM >= numberOfPF)
+	mapOut(start, pages);
+	for (size_t i = 0; i < pages; i++)
 	{
-		void *kickedChunkAddr = kickPageFromStack();
-		this->pageOut(kickedChunkAddr);
-		mapOut(kickedChunkAddr);
+		*mappingUnit.logAddr2PTEntryAddr(start + i * pageSize) = 0;
 	}
-
-	mapIn(pageStartAddressOfPT);
-
-	writePageActivate(pageStartAddressOfPT);
-
-	//change PT to Present in PD
-	mappingUnit.setPresentBit(pdEntryOfPT, PRESENT);
-	mappingUnit.setAccessed(pdEntryOfPT, ACCESSED);
-	mappingUnit.setPinnedBit(pdEntryOfPT, PINNED);
 }
 
 void *VirtualMem::findStartAddress(void *address)
 {
-	unsigned pageStart = mappingUnit.phyAddr2page(((char *)address) - ((char *)virtualMemStartAddress));
-	return (void *)(((char *)virtualMemStartAddress) + pageStart);
+	size_t pageStart = mappingUnit.phyAddr2page(((char *)address) - virtualMemStartAddress);
+	return (void *)(virtualMemStartAddress + pageStart);
 }
 
 void *VirtualMem::getStart()
 {
-	return (void *)(this->virtualMemStartAddress + ((NUMBER_OF_PT + 1) * PAGETABLE_SIZE));
+	return (void *)(this->virtualMemStartAddress + tableCount * pageSize);
 }
 
 size_t VirtualMem::getSize()
 {
-
-	return FOUR_GB - (NUMBER_OF_PT + 1) * PAGESIZE;
+	return virtualSize;
 }
 
 
@@ -408,7 +1706,29 @@ void *VirtualMem::expand(size_t size)
 
 VirtualMem::~VirtualMem()
 {
-	munmap(this->virtualMemStartAddress, NUMBER_OF_PAGES * PAGESIZE);
-	shm_unlink("phy-Mem");
+	writeBack.stop();
+	swapQueue.close();
+	userFaults.stop();
+	munmap(this->virtualMemStartAddress, tableCount * pageSize + virtualSize);
+	munmap(this->tablePages, tableCount * sizeof(table_entry));
+	munmap(this->tableParents, tableCount * sizeof(unsigned));
+	munmap(this->tableResidents, tableCount * sizeof(unsigned short));
+	munmap(this->idleTables, tableCount * sizeof(unsigned));
+	munmap(this->idleQueued, tableCount * sizeof(bool));
+	munmap(this->freeFrames, MAX_FRAMES * sizeof(unsigned));
+	munmap(this->framePages, MAX_FRAMES * sizeof(void *));
+	munmap(this->frameSlots, MAX_FRAMES * sizeof(unsigned));
+	munmap(this->relocationBuffer, pageSize);
+	if (frameMemory != NULL)
+		munmap(this->frameMemory, (size_t)MAX_FRAMES * pageSize);
+	if (pagemapFd != -1)
+		close(pagemapFd);
+	munmap(this->referencedPages, MAX_FRAMES * sizeof(void *));
+	munmap(this->evictedPages, MAX_FRAMES * sizeof(void *));
+	munmap(this->fillWords, getSize() / pageSize * sizeof(unsigned long));
+	ReplacementPolicy::destroy(policy);
+	compressedSwap.destroy();
+	swapSlots.destroy();
+	close(this->fd);
 }
 
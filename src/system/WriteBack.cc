@@ -0,0 +1,223 @@
+#include "system/WriteBack.h"
+#include "system/VirtualMem.h"
+#include "misc/TraceRing.h"
+#include <sys/mman.h>
+
+void swapFileFailed(const void *address, size_t bytes)
+{
+	traceEvent(TRACE_SWAP_IO_FAILED, address, bytes);
+	traceDrain(STDERR_FILENO);
+	_exit(1);
+}
+
+void WriteBackWorker::start(WriteBack *writeBack)
+{
+	this->writeBack = writeBack;
+	create();
+}
+
+void WriteBackWorker::run()
+{
+	writeBack->work();
+}
+
+bool WriteBack::start(unsigned threads, size_t pageSize, int fd)
+{
+	if (threads == 0)
+	{
+		return true;
+	}
+	this->pageSize = pageSize;
+	buffers = (char *)mmap(NULL, WRITE_BACK_SLOTS * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffers == MAP_FAILED)
+	{
+		buffers = NULL;
+		return false;
+	}
+	for (unsigned i = 0; i < WRITE_BACK_SLOTS; i++)
+	{
+		states[i] = SLOT_FREE;
+	}
+	//without io_uring the slots are written one by one with pwrite
+	if (file.open(fd, WRITE_BACK_SLOTS))
+	{
+		file.registerBuffer(buffers, WRITE_BACK_SLOTS * pageSize);
+	}
+
+	this->threads = threads < MAX_WRITE_BACK_THREADS ? threads : MAX_WRITE_BACK_THREADS;
+	stopping = false;
+	for (unsigned i = 0; i < this->threads; i++)
+	{
+		workers[i].start(this);
+	}
+	return true;
+}
+
+void WriteBack::stop()
+{
+	if (threads == 0)
+	{
+		return;
+	}
+	slotMutex.lock();
+	stopping = true;
+	slotMutex.unlock();
+	workAvailable.notify_all();
+	for (unsigned i = 0; i < threads; i++)
+	{
+		workers[i].join();
+	}
+	threads = 0;
+	file.close();
+	munmap(buffers, WRITE_BACK_SLOTS * pageSize);
+	buffers = NULL;
+}
+
+bool WriteBack::isRunning()
+{
+	return threads != 0;
+}
+
+void WriteBack::wake()
+{
+	if (threads == 0)
+	{
+		return;
+	}
+	slotMutex.lock();
+	bool idle = !pending;
+	pending = true;
+	slotMutex.unlock();
+	if (idle)
+	{
+		workAvailable.notify_one();
+	}
+}
+
+char *WriteBack::claimSlot(off_t offset)
+{
+	std::lock_guard<std::mutex> lock(slotMutex);
+	for (unsigned i = 0; i < WRITE_BACK_SLOTS; i++)
+	{
+		if (states[i] == SLOT_FREE)
+		{
+			states[i] = SLOT_CLAIMED;
+			offsets[i] = offset;
+			inFlight++;
+			return buffers + i * pageSize;
+		}
+	}
+	return NULL;
+}
+
+bool WriteBack::overlaps(off_t offset, size_t bytes)
+{
+	for (unsigned i = 0; i < WRITE_BACK_SLOTS; i++)
+	{
+		if (states[i] != SLOT_FREE && offsets[i] < offset + (off_t)bytes && offset < offsets[i] + (off_t)pageSize)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void WriteBack::waitFor(off_t offset, size_t bytes)
+{
+	if (inFlight == 0)
+	{
+		return;
+	}
+	std::unique_lock<std::mutex> lock(slotMutex);
+	slotWritten.wait(lock, [&] { return !overlaps(offset, bytes); });
+}
+
+void WriteBack::waitAll()
+{
+	if (inFlight == 0)
+	{
+		return;
+	}
+	std::unique_lock<std::mutex> lock(slotMutex);
+	slotWritten.wait(lock, [&] { return inFlight == 0; });
+}
+
+//the claimed slots are written by the worker that filled them or by another one that is faster
+void WriteBack::writeClaimed()
+{
+	std::lock_guard<std::mutex> fileLock(fileMutex);
+	bool writing[WRITE_BACK_SLOTS];
+	slotMutex.lock();
+	for (unsigned i = 0; i < WRITE_BACK_SLOTS; i++)
+	{
+		writing[i] = states[i] == SLOT_CLAIMED;
+		if (writing[i])
+		{
+			states[i] = SLOT_WRITING;
+		}
+	}
+	slotMutex.unlock();
+
+	unsigned count = 0;
+	for (unsigned i = 0; i < WRITE_BACK_SLOTS; i++)
+	{
+		if (writing[i])
+		{
+			file.queueWrite(buffers + i * pageSize, offsets[i], pageSize);
+			count++;
+		}
+	}
+	if (count == 0)
+	{
+		return;
+	}
+	//a page marked clean that isn't on the swap file would be lost at its eviction
+	if (file.complete() != (ssize_t)(count * pageSize))
+	{
+		for (unsigned i = 0; i < WRITE_BACK_SLOTS; i++)
+		{
+			if (writing[i] && !file.writeFully(buffers + i * pageSize, offsets[i], pageSize))
+			{
+				swapFileFailed(buffers + i * pageSize, pageSize);
+			}
+		}
+	}
+
+	slotMutex.lock();
+	for (unsigned i = 0; i < WRITE_BACK_SLOTS; i++)
+	{
+		if (writing[i])
+		{
+			states[i] = SLOT_FREE;
+		}
+	}
+	inFlight -= count;
+	slotMutex.unlock();
+	slotWritten.notify_all();
+}
+
+/*
+	One round cleans pages until a pass over the frames finds none or all slots are
+	in flight, the slots are written between two passes without the VirtualMem lock.
+*/
+void WriteBack::work()
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(slotMutex);
+			workAvailable.wait(lock, [&] { return pending || stopping; });
+			if (stopping)
+			{
+				return;
+			}
+			pending = false;
+		}
+
+		while (memory.cleanColdPages() > 0)
+		{
+			writeClaimed();
+		}
+		writeClaimed();
+	}
+}